@@ -0,0 +1,65 @@
+#pragma once
+
+// The loader / API layer negotiation structures, as described in the OpenXR loader specification.
+// The loader release package does not ship loader_interfaces.h, so they are declared here.
+
+#include <openxr/openxr.h>
+
+typedef enum XrLoaderInterfaceStructs {
+	XR_LOADER_INTERFACE_STRUCT_UNINTIALIZED = 0,
+	XR_LOADER_INTERFACE_STRUCT_LOADER_INFO,
+	XR_LOADER_INTERFACE_STRUCT_API_LAYER_REQUEST,
+	XR_LOADER_INTERFACE_STRUCT_RUNTIME_REQUEST,
+	XR_LOADER_INTERFACE_STRUCT_API_LAYER_CREATE_INFO,
+	XR_LOADER_INTERFACE_STRUCT_API_LAYER_NEXT_INFO,
+} XrLoaderInterfaceStructs;
+
+#define XR_LOADER_INFO_STRUCT_VERSION 1
+typedef struct XrNegotiateLoaderInfo {
+	XrLoaderInterfaceStructs	structType;		// XR_LOADER_INTERFACE_STRUCT_LOADER_INFO
+	uint32_t					structVersion;	// XR_LOADER_INFO_STRUCT_VERSION
+	size_t						structSize;		// sizeof(XrNegotiateLoaderInfo)
+	uint32_t					minInterfaceVersion;
+	uint32_t					maxInterfaceVersion;
+	XrVersion					minApiVersion;
+	XrVersion					maxApiVersion;
+} XrNegotiateLoaderInfo;
+
+struct XrApiLayerCreateInfo;
+typedef XrResult(XRAPI_PTR* PFN_xrCreateApiLayerInstance)(const XrInstanceCreateInfo* info, const struct XrApiLayerCreateInfo* apiLayerInfo, XrInstance* instance);
+
+#define XR_CURRENT_LOADER_API_LAYER_VERSION 1
+#define XR_API_LAYER_INFO_STRUCT_VERSION 1
+typedef struct XrNegotiateApiLayerRequest {
+	XrLoaderInterfaceStructs	structType;		// XR_LOADER_INTERFACE_STRUCT_API_LAYER_REQUEST
+	uint32_t					structVersion;	// XR_API_LAYER_INFO_STRUCT_VERSION
+	size_t						structSize;		// sizeof(XrNegotiateApiLayerRequest)
+	uint32_t					layerInterfaceVersion;
+	XrVersion					layerApiVersion;
+	PFN_xrGetInstanceProcAddr	getInstanceProcAddr;
+	PFN_xrCreateApiLayerInstance	createApiLayerInstance;
+} XrNegotiateApiLayerRequest;
+
+#define XR_API_LAYER_NEXT_INFO_STRUCT_VERSION 1
+typedef struct XrApiLayerNextInfo {
+	XrLoaderInterfaceStructs	structType;		// XR_LOADER_INTERFACE_STRUCT_API_LAYER_NEXT_INFO
+	uint32_t					structVersion;	// XR_API_LAYER_NEXT_INFO_STRUCT_VERSION
+	size_t						structSize;		// sizeof(XrApiLayerNextInfo)
+	char						layerName[XR_MAX_API_LAYER_NAME_SIZE];
+	PFN_xrGetInstanceProcAddr	nextGetInstanceProcAddr;
+	PFN_xrCreateApiLayerInstance	nextCreateApiLayerInstance;
+	struct XrApiLayerNextInfo*	next;
+} XrApiLayerNextInfo;
+
+#define XR_API_LAYER_MAX_SETTINGS_PATH_SIZE 512
+#define XR_API_LAYER_CREATE_INFO_STRUCT_VERSION 1
+typedef struct XrApiLayerCreateInfo {
+	XrLoaderInterfaceStructs	structType;		// XR_LOADER_INTERFACE_STRUCT_API_LAYER_CREATE_INFO
+	uint32_t					structVersion;	// XR_API_LAYER_CREATE_INFO_STRUCT_VERSION
+	size_t						structSize;		// sizeof(XrApiLayerCreateInfo)
+	void*						loaderInstance;	// not used by layers
+	char						settings_file_location[XR_API_LAYER_MAX_SETTINGS_PATH_SIZE];
+	XrApiLayerNextInfo*			nextInfo;
+} XrApiLayerCreateInfo;
+
+typedef XrResult(XRAPI_PTR* PFN_xrNegotiateLoaderApiLayerInterface)(const XrNegotiateLoaderInfo* loaderInfo, const char* layerName, XrNegotiateApiLayerRequest* apiLayerRequest);
@@ -0,0 +1,448 @@
+// OpenXR API layer that counts calls, latency and result codes of the xr* functions in XR_PROFILED_FUNCTIONS,
+// per function and per thread, and prints a summary when the instance is destroyed.
+// Other extension functions are passed through without being counted.
+
+// Windows Header
+#include <Windows.h>
+
+#define XR_USE_GRAPHICS_API_OPENGL
+#define XR_USE_PLATFORM_WIN32
+#include <openxr/openxr.h>
+#include <openxr/openxr_platform.h>
+
+#include "LoaderInterface.h"
+
+// STD Header
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#define XR_PROFILER_LAYER_NAME "XR_APILAYER_KHERESY_profiler"
+
+#pragma region Profiled functions
+// Core 1.0 functions, and the functions of the extensions the samples enable; the other extensions they enable
+// (composition layer cube and equirect2, Varjo quad views) add no functions.
+// xrCreateInstance is timed in xrCreateApiLayerInstance, the part below this layer; xrGetInstanceProcAddr itself
+// is not profiled, it returns the hooks, and the functions called before an instance exists never reach a layer.
+#define XR_PROFILED_FUNCTIONS(_)			\
+	_(xrCreateInstance)						\
+	_(xrDestroyInstance)					\
+	_(xrGetInstanceProperties)				\
+	_(xrPollEvent)							\
+	_(xrResultToString)						\
+	_(xrStructureTypeToString)				\
+	_(xrGetSystem)							\
+	_(xrGetSystemProperties)				\
+	_(xrEnumerateEnvironmentBlendModes)		\
+	_(xrCreateSession)						\
+	_(xrDestroySession)						\
+	_(xrEnumerateReferenceSpaces)			\
+	_(xrCreateReferenceSpace)				\
+	_(xrGetReferenceSpaceBoundsRect)		\
+	_(xrCreateActionSpace)					\
+	_(xrLocateSpace)						\
+	_(xrDestroySpace)						\
+	_(xrEnumerateViewConfigurations)		\
+	_(xrGetViewConfigurationProperties)		\
+	_(xrEnumerateViewConfigurationViews)	\
+	_(xrEnumerateSwapchainFormats)			\
+	_(xrCreateSwapchain)					\
+	_(xrDestroySwapchain)					\
+	_(xrEnumerateSwapchainImages)			\
+	_(xrAcquireSwapchainImage)				\
+	_(xrWaitSwapchainImage)					\
+	_(xrReleaseSwapchainImage)				\
+	_(xrBeginSession)						\
+	_(xrEndSession)							\
+	_(xrRequestExitSession)					\
+	_(xrWaitFrame)							\
+	_(xrBeginFrame)							\
+	_(xrEndFrame)							\
+	_(xrLocateViews)						\
+	_(xrStringToPath)						\
+	_(xrPathToString)						\
+	_(xrCreateActionSet)					\
+	_(xrDestroyActionSet)					\
+	_(xrCreateAction)						\
+	_(xrDestroyAction)						\
+	_(xrSuggestInteractionProfileBindings)	\
+	_(xrAttachSessionActionSets)			\
+	_(xrGetCurrentInteractionProfile)		\
+	_(xrGetActionStateBoolean)				\
+	_(xrGetActionStateFloat)				\
+	_(xrGetActionStateVector2f)				\
+	_(xrGetActionStatePose)					\
+	_(xrSyncActions)						\
+	_(xrEnumerateBoundSourcesForAction)		\
+	_(xrGetInputSourceLocalizedName)		\
+	_(xrApplyHapticFeedback)				\
+	_(xrStopHapticFeedback)					\
+	_(xrGetOpenGLGraphicsRequirementsKHR)	\
+	_(xrGetVisibilityMaskKHR)
+
+enum class EFunc : uint32_t
+{
+#define XR_PROFILER_ENUM(name) name,
+	XR_PROFILED_FUNCTIONS(XR_PROFILER_ENUM)
+#undef XR_PROFILER_ENUM
+	NUM
+};
+
+constexpr size_t FUNC_NUM = (size_t)EFunc::NUM;
+
+const char* gsFunctionNames[FUNC_NUM] = {
+#define XR_PROFILER_NAME(name) #name,
+	XR_PROFILED_FUNCTIONS(XR_PROFILER_NAME)
+#undef XR_PROFILER_NAME
+};
+#pragma endregion
+
+#pragma region Counters
+// Written only by the owner thread, so relaxed atomics are enough; they are atomic for the reader of the summary.
+struct SFuncStats
+{
+	static constexpr size_t HISTOGRAM_SIZE = 32;	// bucket i: [2^i, 2^(i+1)) ns
+	static constexpr size_t ERROR_SLOTS = 8;
+
+	std::atomic<uint64_t>	uCalls{ 0 };
+	std::atomic<uint64_t>	uTotalNs{ 0 };
+	std::atomic<uint64_t>	uMaxNs{ 0 };
+	std::atomic<uint64_t>	aHistogram[HISTOGRAM_SIZE];
+
+	// results other than XR_SUCCESS; XR_SUCCESS marks a free slot
+	std::atomic<int32_t>	aErrorCodes[ERROR_SLOTS];
+	std::atomic<uint64_t>	aErrorCounts[ERROR_SLOTS];
+	std::atomic<uint64_t>	uOtherErrors{ 0 };
+
+	SFuncStats()
+	{
+		for (auto& rBucket : aHistogram)
+			rBucket.store(0, std::memory_order_relaxed);
+		for (size_t i = 0; i < ERROR_SLOTS; ++i)
+		{
+			aErrorCodes[i].store(XR_SUCCESS, std::memory_order_relaxed);
+			aErrorCounts[i].store(0, std::memory_order_relaxed);
+		}
+	}
+
+	void record(XrResult xrResult, uint64_t uNs)
+	{
+		uCalls.store(uCalls.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+		uTotalNs.store(uTotalNs.load(std::memory_order_relaxed) + uNs, std::memory_order_relaxed);
+		if (uNs > uMaxNs.load(std::memory_order_relaxed))
+			uMaxNs.store(uNs, std::memory_order_relaxed);
+
+		auto& rBucket = aHistogram[bucket(uNs)];
+		rBucket.store(rBucket.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+
+		if (xrResult == XR_SUCCESS)
+			return;
+
+		for (size_t i = 0; i < ERROR_SLOTS; ++i)
+		{
+			const int32_t iCode = aErrorCodes[i].load(std::memory_order_relaxed);
+			if (iCode == XR_SUCCESS)
+				aErrorCodes[i].store(xrResult, std::memory_order_relaxed);
+			else if (iCode != xrResult)
+				continue;
+
+			aErrorCounts[i].store(aErrorCounts[i].load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+			return;
+		}
+		uOtherErrors.store(uOtherErrors.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+	}
+
+	static size_t bucket(uint64_t uNs)
+	{
+		size_t uBucket = 0;
+		while (uNs > 1 && uBucket < HISTOGRAM_SIZE - 1)
+		{
+			uNs >>= 1;
+			++uBucket;
+		}
+		return uBucket;
+	}
+};
+
+struct SThreadStats
+{
+	std::thread::id	idThread;
+	SFuncStats		aFuncs[FUNC_NUM];
+};
+
+// Thread blocks are registered once per thread, and kept until the process exits
+std::mutex									gmtxThreads;
+std::vector<std::unique_ptr<SThreadStats>>	gvThreadStats;
+
+SThreadStats& getThreadStats()
+{
+	thread_local SThreadStats* tpStats = nullptr;
+	if (tpStats == nullptr)
+	{
+		auto pStats = std::make_unique<SThreadStats>();
+		pStats->idThread = std::this_thread::get_id();
+		tpStats = pStats.get();
+
+		std::lock_guard<std::mutex> lock(gmtxThreads);
+		gvThreadStats.push_back(std::move(pStats));
+	}
+	return *tpStats;
+}
+#pragma endregion
+
+#pragma region Dispatch
+// One instance at a time, as the samples use
+PFN_xrGetInstanceProcAddr	gNextGetInstanceProcAddr = nullptr;
+PFN_xrVoidFunction			gNextFunctions[FUNC_NUM] = {};
+XrInstance					gInstance = XR_NULL_HANDLE;
+
+// Call the next layer or runtime, and time it
+template<EFunc FUNC, typename TPFN>
+struct SHook;
+
+template<EFunc FUNC, typename... TArgs>
+struct SHook<FUNC, XrResult(XRAPI_PTR*)(TArgs...)>
+{
+	using TPFN = XrResult(XRAPI_PTR*)(TArgs...);
+
+	static XrResult XRAPI_CALL call(TArgs... args)
+	{
+		const auto tpBegin = std::chrono::steady_clock::now();
+		const XrResult xrResult = reinterpret_cast<TPFN>(gNextFunctions[(size_t)FUNC])(args...);
+		const auto tpEnd = std::chrono::steady_clock::now();
+
+		getThreadStats().aFuncs[(size_t)FUNC].record(xrResult, (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(tpEnd - tpBegin).count());
+		return xrResult;
+	}
+};
+
+PFN_xrVoidFunction gHooks[FUNC_NUM] = {
+#define XR_PROFILER_HOOK(name) reinterpret_cast<PFN_xrVoidFunction>(&SHook<EFunc::name, PFN_##name>::call),
+	XR_PROFILED_FUNCTIONS(XR_PROFILER_HOOK)
+#undef XR_PROFILER_HOOK
+};
+#pragma endregion
+
+#pragma region Summary
+std::string toResultString(XrResult xrResult)
+{
+	const auto func = reinterpret_cast<PFN_xrResultToString>(gNextFunctions[(size_t)EFunc::xrResultToString]);
+	char sMsg[XR_MAX_RESULT_STRING_SIZE];
+	if (func != nullptr && func(gInstance, xrResult, sMsg) == XR_SUCCESS)
+		return sMsg;
+	return std::to_string(xrResult);
+}
+
+// Upper bound of the bucket holding the given fraction of the calls, in us
+double percentileUs(const uint64_t* aHistogram, uint64_t uCalls, double dFraction)
+{
+	const uint64_t uTarget = (uint64_t)(uCalls * dFraction);
+	uint64_t uSum = 0;
+	for (size_t i = 0; i < SFuncStats::HISTOGRAM_SIZE; ++i)
+	{
+		uSum += aHistogram[i];
+		if (uSum > uTarget)
+			return (double)(2ull << i) / 1000;
+	}
+	return (double)(1ull << SFuncStats::HISTOGRAM_SIZE) / 1000;
+}
+
+void writeSummary(std::ostream& rOut)
+{
+	struct STotal
+	{
+		size_t		uFunc = 0;
+		uint64_t	uCalls = 0, uTotalNs = 0, uMaxNs = 0, uOtherErrors = 0;
+		uint64_t	aHistogram[SFuncStats::HISTOGRAM_SIZE] = {};
+		std::vector<std::pair<int32_t, uint64_t>>	vErrors;
+	};
+
+	std::lock_guard<std::mutex> lock(gmtxThreads);
+	std::vector<STotal> vTotals(FUNC_NUM);
+	for (size_t f = 0; f < FUNC_NUM; ++f)
+	{
+		STotal& rTotal = vTotals[f];
+		rTotal.uFunc = f;
+		for (const auto& pThread : gvThreadStats)
+		{
+			const SFuncStats& rStats = pThread->aFuncs[f];
+			rTotal.uCalls += rStats.uCalls.load(std::memory_order_relaxed);
+			rTotal.uTotalNs += rStats.uTotalNs.load(std::memory_order_relaxed);
+			rTotal.uMaxNs = (std::max)(rTotal.uMaxNs, rStats.uMaxNs.load(std::memory_order_relaxed));
+			rTotal.uOtherErrors += rStats.uOtherErrors.load(std::memory_order_relaxed);
+			for (size_t i = 0; i < SFuncStats::HISTOGRAM_SIZE; ++i)
+				rTotal.aHistogram[i] += rStats.aHistogram[i].load(std::memory_order_relaxed);
+
+			for (size_t i = 0; i < SFuncStats::ERROR_SLOTS; ++i)
+			{
+				const int32_t iCode = rStats.aErrorCodes[i].load(std::memory_order_relaxed);
+				if (iCode == XR_SUCCESS)
+					break;
+
+				const uint64_t uCount = rStats.aErrorCounts[i].load(std::memory_order_relaxed);
+				auto it = std::find_if(rTotal.vErrors.begin(), rTotal.vErrors.end(), [iCode](const std::pair<int32_t, uint64_t>& rPair) { return rPair.first == iCode; });
+				if (it == rTotal.vErrors.end())
+					rTotal.vErrors.emplace_back(iCode, uCount);
+				else
+					it->second += uCount;
+			}
+		}
+	}
+
+	// most expensive first
+	std::sort(vTotals.begin(), vTotals.end(), [](const STotal& a, const STotal& b) { return a.uTotalNs > b.uTotalNs; });
+
+	rOut << "\n[" << XR_PROFILER_LAYER_NAME << "] " << gvThreadStats.size() << " thread(s)\n";
+	rOut << std::left << std::setw(38) << "function" << std::right
+		<< std::setw(10) << "calls" << std::setw(12) << "total ms" << std::setw(10) << "mean us"
+		<< std::setw(10) << "p50 us" << std::setw(10) << "p99 us" << std::setw(10) << "max us" << "  results\n";
+	rOut << std::fixed << std::setprecision(2);
+	for (const auto& rTotal : vTotals)
+	{
+		if (rTotal.uCalls == 0)
+			continue;
+
+		rOut << std::left << std::setw(38) << gsFunctionNames[rTotal.uFunc] << std::right
+			<< std::setw(10) << rTotal.uCalls
+			<< std::setw(12) << rTotal.uTotalNs / 1e6
+			<< std::setw(10) << rTotal.uTotalNs / 1e3 / rTotal.uCalls
+			<< std::setw(10) << percentileUs(rTotal.aHistogram, rTotal.uCalls, 0.5)
+			<< std::setw(10) << percentileUs(rTotal.aHistogram, rTotal.uCalls, 0.99)
+			<< std::setw(10) << rTotal.uMaxNs / 1e3 << " ";
+		for (const auto& rError : rTotal.vErrors)
+			rOut << " " << toResultString((XrResult)rError.first) << " x" << rError.second;
+		if (rTotal.uOtherErrors > 0)
+			rOut << " others x" << rTotal.uOtherErrors;
+		rOut << "\n";
+	}
+
+	// calls and time of each thread
+	for (const auto& pThread : gvThreadStats)
+	{
+		rOut << "thread " << pThread->idThread << ":";
+		for (size_t f = 0; f < FUNC_NUM; ++f)
+		{
+			const uint64_t uCalls = pThread->aFuncs[f].uCalls.load(std::memory_order_relaxed);
+			if (uCalls > 0)
+				rOut << " " << gsFunctionNames[f] << " x" << uCalls << " (" << pThread->aFuncs[f].uTotalNs.load(std::memory_order_relaxed) / 1e6 << " ms)";
+		}
+		rOut << "\n";
+	}
+	rOut << std::endl;
+}
+
+// Print to stdout, and append to the file in XR_PROFILER_OUTPUT if it is set
+void dumpSummary()
+{
+	std::ostringstream ossSummary;
+	writeSummary(ossSummary);
+	std::cout << ossSummary.str();
+
+	char sPath[MAX_PATH];
+	const DWORD uLength = GetEnvironmentVariableA("XR_PROFILER_OUTPUT", sPath, MAX_PATH);
+	if (uLength > 0 && uLength < MAX_PATH)
+	{
+		std::ofstream fsOut(sPath, std::ios::app);
+		fsOut << ossSummary.str();
+	}
+}
+
+XrResult XRAPI_CALL profilerDestroyInstance(XrInstance instance)
+{
+	// before the call, xrResultToString() still needs the instance
+	dumpSummary();
+	const XrResult xrResult = SHook<EFunc::xrDestroyInstance, PFN_xrDestroyInstance>::call(instance);
+	gInstance = XR_NULL_HANDLE;
+	return xrResult;
+}
+#pragma endregion
+
+#pragma region Layer entry points
+XrResult XRAPI_CALL profilerGetInstanceProcAddr(XrInstance instance, const char* name, PFN_xrVoidFunction* function)
+{
+	if (strcmp(name, "xrGetInstanceProcAddr") == 0)
+	{
+		*function = reinterpret_cast<PFN_xrVoidFunction>(&profilerGetInstanceProcAddr);
+		return XR_SUCCESS;
+	}
+
+	if (gNextGetInstanceProcAddr == nullptr)
+		return XR_ERROR_HANDLE_INVALID;
+
+	// unknown or disabled functions are passed through as they are
+	const XrResult xrResult = gNextGetInstanceProcAddr(instance, name, function);
+	if (xrResult != XR_SUCCESS || *function == nullptr)
+		return xrResult;
+
+	for (size_t f = (size_t)EFunc::xrCreateInstance + 1; f < FUNC_NUM; ++f)
+	{
+		if (strcmp(name, gsFunctionNames[f]) == 0)
+		{
+			gNextFunctions[f] = *function;
+			*function = (f == (size_t)EFunc::xrDestroyInstance) ? reinterpret_cast<PFN_xrVoidFunction>(&profilerDestroyInstance) : gHooks[f];
+			break;
+		}
+	}
+	return xrResult;
+}
+
+XrResult XRAPI_CALL profilerCreateApiLayerInstance(const XrInstanceCreateInfo* info, const XrApiLayerCreateInfo* apiLayerInfo, XrInstance* instance)
+{
+	if (apiLayerInfo == nullptr || apiLayerInfo->structType != XR_LOADER_INTERFACE_STRUCT_API_LAYER_CREATE_INFO ||
+		apiLayerInfo->nextInfo == nullptr || apiLayerInfo->nextInfo->structType != XR_LOADER_INTERFACE_STRUCT_API_LAYER_NEXT_INFO ||
+		strcmp(apiLayerInfo->nextInfo->layerName, XR_PROFILER_LAYER_NAME) != 0)
+		return XR_ERROR_INITIALIZATION_FAILED;
+
+	// the next layer gets the rest of the chain
+	XrApiLayerCreateInfo nextApiLayerInfo = *apiLayerInfo;
+	nextApiLayerInfo.nextInfo = apiLayerInfo->nextInfo->next;
+
+	const auto tpBegin = std::chrono::steady_clock::now();
+	const XrResult xrResult = apiLayerInfo->nextInfo->nextCreateApiLayerInstance(info, &nextApiLayerInfo, instance);
+	const auto tpEnd = std::chrono::steady_clock::now();
+	getThreadStats().aFuncs[(size_t)EFunc::xrCreateInstance].record(xrResult, (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(tpEnd - tpBegin).count());
+	if (XR_FAILED(xrResult))
+		return xrResult;
+
+	gInstance = *instance;
+	gNextGetInstanceProcAddr = apiLayerInfo->nextInfo->nextGetInstanceProcAddr;
+
+	// resolve all known functions now, so the summary can use xrResultToString() and calls made
+	// through the loader trampolines are counted too
+	for (size_t f = (size_t)EFunc::xrCreateInstance + 1; f < FUNC_NUM; ++f)
+	{
+		PFN_xrVoidFunction func = nullptr;
+		if (gNextGetInstanceProcAddr(gInstance, gsFunctionNames[f], &func) == XR_SUCCESS)
+			gNextFunctions[f] = func;
+	}
+	return xrResult;
+}
+
+extern "C" __declspec(dllexport) XrResult XRAPI_CALL xrNegotiateLoaderApiLayerInterface(const XrNegotiateLoaderInfo* loaderInfo, const char* layerName, XrNegotiateApiLayerRequest* apiLayerRequest)
+{
+	if (loaderInfo == nullptr || apiLayerRequest == nullptr ||
+		loaderInfo->structType != XR_LOADER_INTERFACE_STRUCT_LOADER_INFO ||
+		loaderInfo->structVersion != XR_LOADER_INFO_STRUCT_VERSION || loaderInfo->structSize != sizeof(XrNegotiateLoaderInfo) ||
+		apiLayerRequest->structType != XR_LOADER_INTERFACE_STRUCT_API_LAYER_REQUEST ||
+		apiLayerRequest->structVersion != XR_API_LAYER_INFO_STRUCT_VERSION || apiLayerRequest->structSize != sizeof(XrNegotiateApiLayerRequest) ||
+		loaderInfo->minInterfaceVersion > XR_CURRENT_LOADER_API_LAYER_VERSION || loaderInfo->maxInterfaceVersion < XR_CURRENT_LOADER_API_LAYER_VERSION ||
+		(layerName != nullptr && strcmp(layerName, XR_PROFILER_LAYER_NAME) != 0))
+		return XR_ERROR_INITIALIZATION_FAILED;
+
+	apiLayerRequest->layerInterfaceVersion = XR_CURRENT_LOADER_API_LAYER_VERSION;
+	apiLayerRequest->layerApiVersion = XR_CURRENT_API_VERSION;
+	apiLayerRequest->getInstanceProcAddr = &profilerGetInstanceProcAddr;
+	apiLayerRequest->createApiLayerInstance = &profilerCreateApiLayerInstance;
+	return XR_SUCCESS;
+}
+#pragma endregion
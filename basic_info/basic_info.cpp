@@ -2,9 +2,16 @@
 #include <vector>
 #include <sstream>
 
+// Windows Header, only for the hidden OpenGL context used to list swapchain formats
+#include <Windows.h>
+
+#define XR_USE_GRAPHICS_API_OPENGL
+#define XR_USE_PLATFORM_WIN32
 #include <openxr/openxr.h>
+#include <openxr/openxr_platform.h>
 
 #pragma comment( lib, "openxr_loader.lib" )
+#pragma comment( lib, "opengl32.lib" )
 
 // OpenXR instance
 XrInstance gInstance;
@@ -67,6 +74,48 @@ std::string toString(const XrEnvironmentBlendMode& rMode)
 	return "Unknown Mode";
 }
 
+std::string toSwapchainFormatString(const int64_t& iFormat)
+{
+	// OpenGL internal formats, values from glcorearb.h
+	switch (iFormat)
+	{
+	case 0x8D62:
+		return "GL_RGB565";
+	case 0x8058:
+		return "GL_RGBA8";
+	case 0x8C41:
+		return "GL_SRGB8";
+	case 0x8C43:
+		return "GL_SRGB8_ALPHA8";
+	case 0x8059:
+		return "GL_RGB10_A2";
+	case 0x8C3A:
+		return "GL_R11F_G11F_B10F";
+	case 0x881B:
+		return "GL_RGB16F";
+	case 0x881A:
+		return "GL_RGBA16F";
+	case 0x805B:
+		return "GL_RGBA16";
+	case 0x8814:
+		return "GL_RGBA32F";
+	case 0x81A5:
+		return "GL_DEPTH_COMPONENT16";
+	case 0x81A6:
+		return "GL_DEPTH_COMPONENT24";
+	case 0x8CAC:
+		return "GL_DEPTH_COMPONENT32F";
+	case 0x88F0:
+		return "GL_DEPTH24_STENCIL8";
+	case 0x8CAD:
+		return "GL_DEPTH32F_STENCIL8";
+	}
+
+	std::ostringstream oss;
+	oss << "0x" << std::hex << iFormat;
+	return oss.str();
+}
+
 std::ostream& operator<<(std::ostream& oss, const XrApiLayerProperties& rAPI)
 {
 	oss << rAPI.layerName << " (ver " << toString(rAPI.specVersion) << "/" << rAPI.layerVersion << "): " << rAPI.description;
@@ -291,6 +340,72 @@ int main(int argc, char** argv)
 	}
 	#pragma endregion
 
+	#pragma region Swapchain formats
+	// xrEnumerateSwapchainFormats() needs a session, and an OpenGL session needs a context,
+	// so create a hidden window only for this query
+	if (!vSysId.empty())
+	{
+		std::cout << "Enumerate swapchain formats for system " << vSysId[0] << std::endl;
+
+		WNDCLASSW wc = {};
+		wc.style = CS_OWNDC;
+		wc.lpfnWndProc = DefWindowProcW;
+		wc.hInstance = GetModuleHandleW(nullptr);
+		wc.lpszClassName = L"OpenXRBasicInfo";
+		RegisterClassW(&wc);
+
+		HWND hWnd = CreateWindowW(wc.lpszClassName, L"basic_info", WS_OVERLAPPEDWINDOW, CW_USEDEFAULT, CW_USEDEFAULT, 16, 16, nullptr, nullptr, wc.hInstance, nullptr);
+		HDC hDC = GetDC(hWnd);
+
+		PIXELFORMATDESCRIPTOR pfd = {};
+		pfd.nSize = sizeof(pfd);
+		pfd.nVersion = 1;
+		pfd.dwFlags = PFD_DRAW_TO_WINDOW | PFD_SUPPORT_OPENGL | PFD_DOUBLEBUFFER;
+		pfd.iPixelType = PFD_TYPE_RGBA;
+		pfd.cColorBits = 32;
+		pfd.iLayerType = PFD_MAIN_PLANE;
+		SetPixelFormat(hDC, ChoosePixelFormat(hDC, &pfd), &pfd);
+
+		HGLRC hGLRC = wglCreateContext(hDC);
+		if (hGLRC != nullptr && wglMakeCurrent(hDC, hGLRC))
+		{
+			// graphics requirements must be queried before the session is created
+			PFN_xrGetOpenGLGraphicsRequirementsKHR func = nullptr;
+			XrGraphicsRequirementsOpenGLKHR reqOpenGL{ XR_TYPE_GRAPHICS_REQUIREMENTS_OPENGL_KHR };
+			if (xrWORK(xrGetInstanceProcAddr(gInstance, "xrGetOpenGLGraphicsRequirementsKHR", (PFN_xrVoidFunction*)&func)) &&
+				xrWORK(func(gInstance, vSysId[0], &reqOpenGL)))
+			{
+				XrGraphicsBindingOpenGLWin32KHR gbOpenGL{ XR_TYPE_GRAPHICS_BINDING_OPENGL_WIN32_KHR, nullptr, hDC, hGLRC };
+				XrSessionCreateInfo infoSession{ XR_TYPE_SESSION_CREATE_INFO, &gbOpenGL, 0, vSysId[0] };
+				XrSession xrSession = XR_NULL_HANDLE;
+				if (xrWORK(xrCreateSession(gInstance, &infoSession, &xrSession)))
+				{
+					uint32_t uFormatNum = 0;
+					if (xrWORK(xrEnumerateSwapchainFormats(xrSession, 0, &uFormatNum, nullptr)) && uFormatNum > 0)
+					{
+						std::cout << " > Found " << uFormatNum << " formats (runtime preference order)\n";
+						std::vector<int64_t> vFormats(uFormatNum);
+						if (xrWORK(xrEnumerateSwapchainFormats(xrSession, uFormatNum, &uFormatNum, vFormats.data())))
+						{
+							for (const auto& iFormat : vFormats)
+								std::cout << "  - " << toSwapchainFormatString(iFormat) << "\n";
+						}
+					}
+					xrWORK(xrDestroySession(xrSession));
+				}
+			}
+			wglMakeCurrent(nullptr, nullptr);
+		}
+
+		if (hGLRC != nullptr)
+			wglDeleteContext(hGLRC);
+		ReleaseDC(hWnd, hDC);
+		DestroyWindow(hWnd);
+		UnregisterClassW(wc.lpszClassName, wc.hInstance);
+		std::cout << "\n";
+	}
+	#pragma endregion
+
 	#pragma region Destroy Instance
 	xrWORK(xrDestroyInstance(gInstance));
 	#pragma endregion
@@ -0,0 +1,689 @@
+#pragma once
+
+// Windows Header
+#include <Windows.h>
+
+#include <GL/glew.h>
+#include <GL/wglew.h>
+
+#include "Handle.h"
+#include "ThreadPool.h"
+
+// STD Header
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#pragma region File format
+// Meshes and textures are stored exactly as they are uploaded, so loading is a memory map and a copy.
+// All offsets are from the start of the file and aligned to 16 bytes.
+struct SMeshFileHeader
+{
+	char		sMagic[4];			// "OXRM"
+	uint32_t	uVersion;			// 1
+	uint32_t	uVertexNum;
+	uint32_t	uVertexStride;		// bytes; position (3 float) + normal (3 float)
+	uint32_t	uIndexNum;			// uint32 indices, triangle list
+	uint32_t	uReserved;
+	uint64_t	uVertexOffset;
+	uint64_t	uIndexOffset;
+	float		vBoundCenter[3];
+	float		fBoundRadius;
+};
+
+struct STextureFileHeader
+{
+	char		sMagic[4];			// "OXRT"
+	uint32_t	uVersion;			// 1
+	uint32_t	uWidth;
+	uint32_t	uHeight;
+	uint32_t	uMipNum;			// at most 16
+	uint32_t	uInternalFormat;	// GL_RGBA8 or GL_SRGB8_ALPHA8, data is always RGBA 8 bit
+	uint64_t	aMipOffset[16];
+};
+
+namespace AssetFile
+{
+	inline uint64_t align16(uint64_t uOffset)
+	{
+		return (uOffset + 15) & ~(uint64_t)15;
+	}
+
+	// vVertices: position + normal per vertex
+	inline bool writeMesh(const std::string& sFilename, const std::vector<float>& vVertices, const std::vector<uint32_t>& vIndices)
+	{
+		SMeshFileHeader mHeader = {};
+		std::memcpy(mHeader.sMagic, "OXRM", 4);
+		mHeader.uVersion = 1;
+		mHeader.uVertexStride = 6 * sizeof(float);
+		mHeader.uVertexNum = (uint32_t)(vVertices.size() / 6);
+		mHeader.uIndexNum = (uint32_t)vIndices.size();
+		mHeader.uVertexOffset = align16(sizeof(SMeshFileHeader));
+		mHeader.uIndexOffset = align16(mHeader.uVertexOffset + vVertices.size() * sizeof(float));
+
+		// bounding sphere around the box center
+		float vMin[3] = { 0, 0, 0 }, vMax[3] = { 0, 0, 0 };
+		for (size_t i = 0; i < vVertices.size(); i += 6)
+		{
+			for (int j = 0; j < 3; ++j)
+			{
+				vMin[j] = (i == 0) ? vVertices[j] : (std::min)(vMin[j], vVertices[i + j]);
+				vMax[j] = (i == 0) ? vVertices[j] : (std::max)(vMax[j], vVertices[i + j]);
+			}
+		}
+		for (int j = 0; j < 3; ++j)
+			mHeader.vBoundCenter[j] = (vMin[j] + vMax[j]) / 2;
+		for (size_t i = 0; i < vVertices.size(); i += 6)
+		{
+			const float dx = vVertices[i] - mHeader.vBoundCenter[0], dy = vVertices[i + 1] - mHeader.vBoundCenter[1], dz = vVertices[i + 2] - mHeader.vBoundCenter[2];
+			mHeader.fBoundRadius = (std::max)(mHeader.fBoundRadius, sqrtf(dx * dx + dy * dy + dz * dz));
+		}
+
+		std::ofstream fsOut(sFilename, std::ios::binary);
+		if (!fsOut.is_open())
+			return false;
+
+		std::vector<char> vPadding(16, 0);
+		fsOut.write((const char*)&mHeader, sizeof(mHeader));
+		fsOut.write(vPadding.data(), mHeader.uVertexOffset - sizeof(mHeader));
+		fsOut.write((const char*)vVertices.data(), vVertices.size() * sizeof(float));
+		fsOut.write(vPadding.data(), mHeader.uIndexOffset - mHeader.uVertexOffset - vVertices.size() * sizeof(float));
+		fsOut.write((const char*)vIndices.data(), vIndices.size() * sizeof(uint32_t));
+		return fsOut.good();
+	}
+
+	// vMips: RGBA 8 bit data of each mip level, from level 0
+	inline bool writeTexture(const std::string& sFilename, uint32_t uWidth, uint32_t uHeight, const std::vector<std::vector<uint8_t>>& vMips, bool bSRGB)
+	{
+		STextureFileHeader mHeader = {};
+		std::memcpy(mHeader.sMagic, "OXRT", 4);
+		mHeader.uVersion = 1;
+		mHeader.uWidth = uWidth;
+		mHeader.uHeight = uHeight;
+		mHeader.uMipNum = (uint32_t)(std::min)(vMips.size(), (size_t)16);
+		mHeader.uInternalFormat = bSRGB ? GL_SRGB8_ALPHA8 : GL_RGBA8;
+
+		uint64_t uOffset = align16(sizeof(STextureFileHeader));
+		for (uint32_t i = 0; i < mHeader.uMipNum; ++i)
+		{
+			mHeader.aMipOffset[i] = uOffset;
+			uOffset = align16(uOffset + vMips[i].size());
+		}
+
+		std::ofstream fsOut(sFilename, std::ios::binary);
+		if (!fsOut.is_open())
+			return false;
+
+		std::vector<char> vPadding(16, 0);
+		fsOut.write((const char*)&mHeader, sizeof(mHeader));
+		uint64_t uWritten = sizeof(mHeader);
+		for (uint32_t i = 0; i < mHeader.uMipNum; ++i)
+		{
+			fsOut.write(vPadding.data(), mHeader.aMipOffset[i] - uWritten);
+			fsOut.write((const char*)vMips[i].data(), vMips[i].size());
+			uWritten = mHeader.aMipOffset[i] + vMips[i].size();
+		}
+		return fsOut.good();
+	}
+}
+#pragma endregion
+
+// Read-only memory map of a whole file
+class CMappedFile
+{
+public:
+	CMappedFile() = default;
+	CMappedFile(const CMappedFile&) = delete;
+	CMappedFile& operator=(const CMappedFile&) = delete;
+
+	~CMappedFile()
+	{
+		close();
+	}
+
+	bool open(const std::string& sFilename)
+	{
+		close();
+		m_hFile = CreateFileA(sFilename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+		if (m_hFile == INVALID_HANDLE_VALUE)
+		{
+			m_hFile = nullptr;
+			return false;
+		}
+
+		LARGE_INTEGER liSize;
+		if (!GetFileSizeEx(m_hFile, &liSize) || liSize.QuadPart == 0)
+		{
+			close();
+			return false;
+		}
+		m_uSize = (size_t)liSize.QuadPart;
+
+		m_hMapping = CreateFileMappingA(m_hFile, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		if (m_hMapping != nullptr)
+			m_pData = static_cast<const uint8_t*>(MapViewOfFile(m_hMapping, FILE_MAP_READ, 0, 0, 0));
+
+		if (m_pData == nullptr)
+		{
+			close();
+			return false;
+		}
+		return true;
+	}
+
+	void close()
+	{
+		if (m_pData != nullptr)
+			UnmapViewOfFile(m_pData);
+		if (m_hMapping != nullptr)
+			CloseHandle(m_hMapping);
+		if (m_hFile != nullptr)
+			CloseHandle(m_hFile);
+		m_pData = nullptr;
+		m_hMapping = nullptr;
+		m_hFile = nullptr;
+		m_uSize = 0;
+	}
+
+	const uint8_t* data() const
+	{
+		return m_pData;
+	}
+
+	size_t size() const
+	{
+		return m_uSize;
+	}
+
+protected:
+	HANDLE			m_hFile = nullptr;
+	HANDLE			m_hMapping = nullptr;
+	const uint8_t*	m_pData = nullptr;
+	size_t			m_uSize = 0;
+};
+
+// Load meshes and textures without blocking the render thread:
+//  1. a loader thread pool maps and validates the files,
+//  2. an upload thread with a shared GL context copies them through a persistently mapped staging buffer (PBO),
+//     a few slices at a time, and puts a fence after each resource,
+//  3. update() on the render thread makes a resource visible once its fence signaled.
+class CAssetStreamer
+{
+public:
+	struct SMesh
+	{
+		CGLBuffer		glVertexBuffer;
+		CGLBuffer		glIndexBuffer;
+		CGLVertexArray	glVAO;		// VAOs are not shared between contexts, created on the render thread
+		GLsizei			iIndexNum = 0;
+		float			vBoundCenter[3] = { 0, 0, 0 };
+		float			fBoundRadius = 0;
+	};
+
+	struct STexture
+	{
+		CGLTexture	glTexture;
+		uint32_t	uWidth = 0;
+		uint32_t	uHeight = 0;
+	};
+
+public:
+	CAssetStreamer() = default;
+	CAssetStreamer(const CAssetStreamer&) = delete;
+	CAssetStreamer& operator=(const CAssetStreamer&) = delete;
+
+	~CAssetStreamer()
+	{
+		stop();
+	}
+
+	// Must be called on the render thread with its context current
+	bool start(size_t uLoaderThreads = 2, size_t uStagingSize = 8 * 1024 * 1024)
+	{
+		HDC hDC = wglGetCurrentDC();
+		HGLRC hMainRC = wglGetCurrentContext();
+		const int aAttribs[] = {
+			WGL_CONTEXT_MAJOR_VERSION_ARB, 4,
+			WGL_CONTEXT_MINOR_VERSION_ARB, 5,
+			WGL_CONTEXT_PROFILE_MASK_ARB, WGL_CONTEXT_CORE_PROFILE_BIT_ARB,
+			0 };
+		m_hUploadRC = wglCreateContextAttribsARB(hDC, hMainRC, aAttribs);
+		if (m_hUploadRC == nullptr)
+		{
+			std::cout << "Error: can't create the shared context for asset upload" << std::endl;
+			return false;
+		}
+
+		m_uStagingSize = uStagingSize;
+		m_pLoaderPool = std::make_unique<CThreadPool>(uLoaderThreads);
+		m_bStop = false;
+		m_threadUpload = std::thread([this, hDC]() { uploadLoop(hDC); });
+		return true;
+	}
+
+	// Stop the threads and free the streamed resources; on the render thread, while its context is current
+	void stop()
+	{
+		m_pLoaderPool.reset();
+		if (m_threadUpload.joinable())
+		{
+			{
+				std::lock_guard<std::mutex> lock(m_mtxUpload);
+				m_bStop = true;
+			}
+			m_cvUpload.notify_all();
+			m_threadUpload.join();
+		}
+		if (m_hUploadRC != nullptr)
+		{
+			wglDeleteContext(m_hUploadRC);
+			m_hUploadRC = nullptr;
+		}
+
+		for (auto& pAsset : m_vAssets)
+		{
+			if (pAsset->glFence != nullptr)
+			{
+				glDeleteSync(pAsset->glFence);
+				pAsset->glFence = nullptr;
+			}
+		}
+		m_qToUpload.clear();
+		m_vUploaded.clear();
+		m_vFailed.clear();
+		m_vFenced.clear();
+		m_uPending = 0;
+		m_vAssets.clear();
+	}
+
+	// Queue a file, return its id for getMesh() / getTexture()
+	uint32_t requestMesh(const std::string& sFilename)
+	{
+		return request(sFilename, false);
+	}
+
+	uint32_t requestTexture(const std::string& sFilename)
+	{
+		return request(sFilename, true);
+	}
+
+	// Render thread, once per frame: publish resources whose upload finished, and adapt the upload rate to the
+	// last frame time, the larger of its CPU and GPU time
+	void update(double dLastFrameMs)
+	{
+		if (m_uPending > 0)
+		{
+			if (dLastFrameMs > m_dFrameBoundMs)
+			{
+				++m_uFramesOverBound;
+				m_uSliceBytes = (std::max)(m_uSliceBytes.load() / 2, (size_t)64 * 1024);
+			}
+			else
+			{
+				m_uSliceBytes = (std::min)(m_uSliceBytes.load() + 64 * 1024, m_uStagingSize / 2);
+			}
+			m_dMaxFrameMs = (std::max)(m_dMaxFrameMs, dLastFrameMs);
+		}
+
+		std::vector<std::shared_ptr<SAsset>> vUploaded, vFailed;
+		{
+			std::lock_guard<std::mutex> lock(m_mtxUpload);
+			vUploaded.swap(m_vUploaded);
+			vFailed.swap(m_vFailed);
+		}
+		for (auto& pAsset : vUploaded)
+			m_vFenced.push_back(pAsset);
+		for (auto& pAsset : vFailed)
+		{
+			std::cout << "Error: can't load " << pAsset->sFilename << std::endl;
+			finishAsset();
+		}
+
+		for (auto it = m_vFenced.begin(); it != m_vFenced.end();)
+		{
+			SAsset& rAsset = **it;
+			const GLenum eRes = glClientWaitSync(rAsset.glFence, 0, 0);
+			if (eRes != GL_ALREADY_SIGNALED && eRes != GL_CONDITION_SATISFIED)
+			{
+				++it;
+				continue;
+			}
+
+			glDeleteSync(rAsset.glFence);
+			rAsset.glFence = nullptr;
+			if (!rAsset.bTexture)
+				createVertexArray(rAsset.mMesh);
+			rAsset.bResident = true;
+			it = m_vFenced.erase(it);
+			finishAsset();
+		}
+	}
+
+	// nullptr until the resource is resident
+	const SMesh* getMesh(uint32_t uId) const
+	{
+		const SAsset* pAsset = getAsset(uId);
+		return (pAsset != nullptr && pAsset->bResident && !pAsset->bTexture) ? &pAsset->mMesh : nullptr;
+	}
+
+	const STexture* getTexture(uint32_t uId) const
+	{
+		const SAsset* pAsset = getAsset(uId);
+		return (pAsset != nullptr && pAsset->bResident && pAsset->bTexture) ? &pAsset->mTexture : nullptr;
+	}
+
+	size_t assetCount() const
+	{
+		return m_vAssets.size();
+	}
+
+	// Frames longer than this shrink the upload slices
+	void setFrameTimeBound(double dMs)
+	{
+		m_dFrameBoundMs = dMs;
+	}
+
+protected:
+	struct SAsset
+	{
+		std::string		sFilename;
+		bool			bTexture = false;
+		CMappedFile		mFile;
+		SMesh			mMesh;
+		STexture		mTexture;
+		GLsync			glFence = nullptr;
+		bool			bResident = false;	// render thread only
+	};
+
+protected:
+	uint32_t request(const std::string& sFilename, bool bTexture)
+	{
+		auto pAsset = std::make_shared<SAsset>();
+		pAsset->sFilename = sFilename;
+		pAsset->bTexture = bTexture;
+		m_vAssets.push_back(pAsset);
+		++m_uPending;
+
+		m_pLoaderPool->push([this, pAsset]() {
+			if (load(*pAsset))
+			{
+				{
+					std::lock_guard<std::mutex> lock(m_mtxUpload);
+					m_qToUpload.push_back(pAsset);
+				}
+				m_cvUpload.notify_one();
+			}
+			else
+			{
+				// reported and counted by update() on the render thread
+				pAsset->mFile.close();
+				std::lock_guard<std::mutex> lock(m_mtxUpload);
+				m_vFailed.push_back(pAsset);
+			}
+		});
+		return (uint32_t)(m_vAssets.size() - 1);
+	}
+
+	// Render thread: one requested asset is resident or failed, report once all are done
+	void finishAsset()
+	{
+		if (--m_uPending == 0)
+		{
+			std::cout << "Assets resident; " << m_uFramesOverBound << " frames over " << m_dFrameBoundMs << " ms while loading, max " << m_dMaxFrameMs << " ms" << std::endl;
+			m_uFramesOverBound = 0;
+			m_dMaxFrameMs = 0;
+		}
+	}
+
+	const SAsset* getAsset(uint32_t uId) const
+	{
+		return uId < m_vAssets.size() ? m_vAssets[uId].get() : nullptr;
+	}
+
+	// true if [uOffset, uOffset + uBytes) is inside a file of uSize bytes, without overflow
+	static bool inFile(uint64_t uOffset, uint64_t uBytes, size_t uSize)
+	{
+		return uOffset <= uSize && uBytes <= uSize - uOffset;
+	}
+
+	// Loader thread: map and validate, so nothing from the file reaches GL unchecked
+	static bool load(SAsset& rAsset)
+	{
+		if (!rAsset.mFile.open(rAsset.sFilename))
+			return false;
+
+		const uint8_t* pData = rAsset.mFile.data();
+		const size_t uSize = rAsset.mFile.size();
+		if (rAsset.bTexture)
+		{
+			if (uSize < sizeof(STextureFileHeader))
+				return false;
+
+			const auto& rHeader = *reinterpret_cast<const STextureFileHeader*>(pData);
+			if (std::memcmp(rHeader.sMagic, "OXRT", 4) != 0 || rHeader.uVersion != 1 || rHeader.uWidth == 0 || rHeader.uHeight == 0 ||
+				(rHeader.uInternalFormat != GL_RGBA8 && rHeader.uInternalFormat != GL_SRGB8_ALPHA8))
+				return false;
+
+			// floor(log2(max(w, h))) + 1 levels at most
+			uint32_t uMaxMipNum = 1;
+			for (uint32_t uExtent = (std::max)(rHeader.uWidth, rHeader.uHeight); uExtent > 1; uExtent >>= 1)
+				++uMaxMipNum;
+			if (rHeader.uMipNum == 0 || rHeader.uMipNum > (std::min)(uMaxMipNum, 16u))
+				return false;
+
+			for (uint32_t i = 0; i < rHeader.uMipNum; ++i)
+			{
+				const uint64_t uMipSize = (uint64_t)(std::max)(1u, rHeader.uWidth >> i) * (std::max)(1u, rHeader.uHeight >> i) * 4;
+				if (!inFile(rHeader.aMipOffset[i], uMipSize, uSize))
+					return false;
+			}
+			rAsset.mTexture.uWidth = rHeader.uWidth;
+			rAsset.mTexture.uHeight = rHeader.uHeight;
+		}
+		else
+		{
+			if (uSize < sizeof(SMeshFileHeader))
+				return false;
+
+			const auto& rHeader = *reinterpret_cast<const SMeshFileHeader*>(pData);
+			if (std::memcmp(rHeader.sMagic, "OXRM", 4) != 0 || rHeader.uVersion != 1 || rHeader.uVertexStride != 6 * sizeof(float) ||
+				!inFile(rHeader.uVertexOffset, (uint64_t)rHeader.uVertexNum * rHeader.uVertexStride, uSize) ||
+				!inFile(rHeader.uIndexOffset, (uint64_t)rHeader.uIndexNum * sizeof(uint32_t), uSize) ||
+				rHeader.uIndexOffset % sizeof(uint32_t) != 0)
+				return false;
+
+			// every index must address a vertex, or the draw would fetch outside the vertex buffer
+			const uint32_t* pIndices = reinterpret_cast<const uint32_t*>(pData + rHeader.uIndexOffset);
+			for (uint32_t i = 0; i < rHeader.uIndexNum; ++i)
+				if (pIndices[i] >= rHeader.uVertexNum)
+					return false;
+
+			rAsset.mMesh.iIndexNum = (GLsizei)rHeader.uIndexNum;
+			std::copy(rHeader.vBoundCenter, rHeader.vBoundCenter + 3, rAsset.mMesh.vBoundCenter);
+			rAsset.mMesh.fBoundRadius = rHeader.fBoundRadius;
+		}
+		return true;
+	}
+
+	// Upload thread: owns the shared context and the staging buffer
+	void uploadLoop(HDC hDC)
+	{
+		wglMakeCurrent(hDC, m_hUploadRC);
+
+		// two halves, so one can be filled while the GPU copies from the other
+		const GLbitfield uFlags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+		CGLBuffer glStaging;
+		glCreateBuffers(1, glStaging.put());
+		glNamedBufferStorage(glStaging, m_uStagingSize, nullptr, uFlags);
+		m_pStaging = static_cast<uint8_t*>(glMapNamedBufferRange(glStaging, 0, m_uStagingSize, uFlags));
+		m_glStaging = glStaging;
+
+		while (true)
+		{
+			std::shared_ptr<SAsset> pAsset;
+			{
+				std::unique_lock<std::mutex> lock(m_mtxUpload);
+				m_cvUpload.wait(lock, [this]() { return m_bStop || !m_qToUpload.empty(); });
+				if (m_bStop)
+					break;
+
+				pAsset = m_qToUpload.front();
+				m_qToUpload.pop_front();
+			}
+
+			if (pAsset->bTexture)
+				uploadTexture(*pAsset);
+			else
+				uploadMesh(*pAsset);
+
+			// the file is not needed once copied
+			pAsset->glFence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+			glFlush();
+			pAsset->mFile.close();
+
+			std::lock_guard<std::mutex> lock(m_mtxUpload);
+			m_vUploaded.push_back(pAsset);
+		}
+
+		for (auto& rFence : m_aStagingFences)
+		{
+			if (rFence != nullptr)
+				glDeleteSync(rFence);
+			rFence = nullptr;
+		}
+		glUnmapNamedBuffer(glStaging);
+		glStaging.reset();
+		wglMakeCurrent(nullptr, nullptr);
+	}
+
+	// Copy uSize bytes through the staging halves, and call func_copy(uStagingOffset, uDstOffset, uBytes) per slice;
+	// slices are multiples of uAlign bytes
+	template<typename FUNC_COPY>
+	void streamThroughStaging(const uint8_t* pSrc, size_t uSize, size_t uAlign, FUNC_COPY func_copy)
+	{
+		const size_t uHalf = m_uStagingSize / 2;
+		size_t uDone = 0;
+		while (uDone < uSize)
+		{
+			GLsync& rFence = m_aStagingFences[m_uStagingHalf];
+			if (rFence != nullptr)
+			{
+				glClientWaitSync(rFence, GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+				glDeleteSync(rFence);
+				rFence = nullptr;
+			}
+
+			const size_t uSlice = (std::max)((std::min)(uHalf, m_uSliceBytes.load()) / uAlign, (size_t)1) * uAlign;
+			const size_t uBytes = (std::min)(uSize - uDone, uSlice);
+			const size_t uOffset = m_uStagingHalf * uHalf;
+			std::memcpy(m_pStaging + uOffset, pSrc + uDone, uBytes);
+			func_copy(uOffset, uDone, uBytes);
+
+			rFence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+			glFlush();
+			m_uStagingHalf = 1 - m_uStagingHalf;
+			uDone += uBytes;
+
+			// give the render thread the driver between slices
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+	}
+
+	void uploadMesh(SAsset& rAsset)
+	{
+		const auto& rHeader = *reinterpret_cast<const SMeshFileHeader*>(rAsset.mFile.data());
+		const size_t uVertexBytes = (size_t)rHeader.uVertexNum * rHeader.uVertexStride;
+		const size_t uIndexBytes = (size_t)rHeader.uIndexNum * sizeof(uint32_t);
+
+		SMesh& rMesh = rAsset.mMesh;
+		glCreateBuffers(1, rMesh.glVertexBuffer.put());
+		glNamedBufferStorage(rMesh.glVertexBuffer, uVertexBytes, nullptr, 0);
+		glCreateBuffers(1, rMesh.glIndexBuffer.put());
+		glNamedBufferStorage(rMesh.glIndexBuffer, uIndexBytes, nullptr, 0);
+
+		const GLuint glVertexBuffer = rMesh.glVertexBuffer, glIndexBuffer = rMesh.glIndexBuffer;
+		streamThroughStaging(rAsset.mFile.data() + rHeader.uVertexOffset, uVertexBytes, rHeader.uVertexStride, [&](size_t uOffset, size_t uDst, size_t uBytes) {
+			glCopyNamedBufferSubData(m_glStaging, glVertexBuffer, uOffset, uDst, uBytes);
+		});
+		streamThroughStaging(rAsset.mFile.data() + rHeader.uIndexOffset, uIndexBytes, sizeof(uint32_t), [&](size_t uOffset, size_t uDst, size_t uBytes) {
+			glCopyNamedBufferSubData(m_glStaging, glIndexBuffer, uOffset, uDst, uBytes);
+		});
+	}
+
+	void uploadTexture(SAsset& rAsset)
+	{
+		const auto& rHeader = *reinterpret_cast<const STextureFileHeader*>(rAsset.mFile.data());
+
+		STexture& rTexture = rAsset.mTexture;
+		glCreateTextures(GL_TEXTURE_2D, 1, rTexture.glTexture.put());
+		glTextureStorage2D(rTexture.glTexture, rHeader.uMipNum, rHeader.uInternalFormat, rHeader.uWidth, rHeader.uHeight);
+		glTextureParameteri(rTexture.glTexture, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+		glTextureParameteri(rTexture.glTexture, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+		const GLuint glTexture = rTexture.glTexture;
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, m_glStaging);
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+		for (uint32_t uMip = 0; uMip < rHeader.uMipNum; ++uMip)
+		{
+			const uint32_t uWidth = (std::max)(1u, rHeader.uWidth >> uMip), uHeight = (std::max)(1u, rHeader.uHeight >> uMip);
+			const size_t uRowBytes = (size_t)uWidth * 4;
+			streamThroughStaging(rAsset.mFile.data() + rHeader.aMipOffset[uMip], uRowBytes * uHeight, uRowBytes, [&](size_t uOffset, size_t uDst, size_t uBytes) {
+				glTextureSubImage2D(glTexture, uMip, 0, (GLint)(uDst / uRowBytes), uWidth, (GLsizei)(uBytes / uRowBytes), GL_RGBA, GL_UNSIGNED_BYTE, (const void*)uOffset);
+			});
+		}
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+	}
+
+	static void createVertexArray(SMesh& rMesh)
+	{
+		glCreateVertexArrays(1, rMesh.glVAO.put());
+		glVertexArrayVertexBuffer(rMesh.glVAO, 0, rMesh.glVertexBuffer, 0, 6 * sizeof(GLfloat));
+		glVertexArrayElementBuffer(rMesh.glVAO, rMesh.glIndexBuffer);
+		glEnableVertexArrayAttrib(rMesh.glVAO, 0);
+		glVertexArrayAttribFormat(rMesh.glVAO, 0, 3, GL_FLOAT, GL_FALSE, 0);
+		glVertexArrayAttribBinding(rMesh.glVAO, 0, 0);
+		glEnableVertexArrayAttrib(rMesh.glVAO, 1);
+		glVertexArrayAttribFormat(rMesh.glVAO, 1, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(GLfloat));
+		glVertexArrayAttribBinding(rMesh.glVAO, 1, 0);
+	}
+
+protected:
+	HGLRC	m_hUploadRC = nullptr;
+	std::unique_ptr<CThreadPool>	m_pLoaderPool;
+	std::thread						m_threadUpload;
+
+	// shared between threads
+	std::mutex				m_mtxUpload;
+	std::condition_variable	m_cvUpload;
+	bool					m_bStop = false;
+	std::deque<std::shared_ptr<SAsset>>		m_qToUpload;
+	std::vector<std::shared_ptr<SAsset>>	m_vUploaded;
+	std::vector<std::shared_ptr<SAsset>>	m_vFailed;
+	std::atomic<size_t>		m_uSliceBytes{ 1024 * 1024 };
+
+	// upload thread only
+	size_t		m_uStagingSize = 0;
+	uint8_t*	m_pStaging = nullptr;
+	GLuint		m_glStaging = 0;
+	size_t		m_uStagingHalf = 0;
+	GLsync		m_aStagingFences[2] = { nullptr, nullptr };
+
+	// render thread only
+	std::vector<std::shared_ptr<SAsset>>	m_vAssets;
+	std::vector<std::shared_ptr<SAsset>>	m_vFenced;
+	uint32_t	m_uPending = 0;			// requested, neither resident nor failed yet
+	double		m_dFrameBoundMs = 11.0;
+	double		m_dMaxFrameMs = 0;
+	uint32_t	m_uFramesOverBound = 0;
+};
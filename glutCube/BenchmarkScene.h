@@ -0,0 +1,467 @@
+#pragma once
+
+#include "OpenXRGL.h"
+#include "GLShader.h"
+#include "GLUniformRing.h"
+#include "Handle.h"
+#include "MeshLOD.h"
+#include "PerfCounter.h"
+
+// STD Header
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <string>
+#include <vector>
+
+// Parameters of a procedural benchmark scene; the same values and seed always give the same scene
+struct SSceneConfig
+{
+	uint32_t	uObjectNum = 1000;			// number of objects
+	uint32_t	uTrianglesPerObject = 1000;	// approximate triangle count of the object mesh
+	uint32_t	uMaterialNum = 8;			// different materials
+	uint32_t	uStateChanges = 8;			// material switches per view
+	uint32_t	uOverdrawLayers = 0;		// full-view blended layers drawn over the scene
+	uint32_t	uSeed = 1;
+};
+
+// Deterministic scripted camera: the local space origin orbits the scene center
+class CScriptedPoseSource
+{
+public:
+	CScriptedPoseSource(float fRadius = 3.0f, float fHeight = 0.0f, uint32_t uFramesPerOrbit = 1800)
+		: m_fRadius(fRadius), m_fHeight(fHeight), m_uFramesPerOrbit(uFramesPerOrbit)
+	{
+	}
+
+	// World to local space transform at the given frame, to be applied after the view matrix
+	COpenXRGL::TMatrix getWorldMatrix(uint64_t uFrame) const
+	{
+		const float fAngle = 6.2831853f * (uFrame % m_uFramesPerOrbit) / m_uFramesPerOrbit;
+		const float c = cosf(fAngle), s = sinf(fAngle);
+
+		// view matrix of a camera at (r sin, h, r cos) looking at the origin with +y up:
+		// rows are side = (c, 0, -s), up = side x forward and -forward, forward = -position / |position|
+		const float px = m_fRadius * s, py = m_fHeight, pz = m_fRadius * c;
+		const float fLength = sqrtf(px * px + py * py + pz * pz);
+		const float fx = -px / fLength, fy = -py / fLength, fz = -pz / fLength;
+		const float sx = c, sz = -s;
+		const float ux = -sz * fy, uy = sz * fx - sx * fz, uz = sx * fy;
+		return {
+			sx,	ux,	-fx,	0,
+			0,	uy,	-fy,	0,
+			sz,	uz,	-fz,	0,
+			-(sx * px + sz * pz),	-(ux * px + uy * py + uz * pz),	fx * px + fy * py + fz * pz,	1
+		};
+	}
+
+protected:
+	float		m_fRadius;
+	float		m_fHeight;
+	uint32_t	m_uFramesPerOrbit;
+};
+
+class CBenchmarkScene
+{
+public:
+	struct SObject
+	{
+		COpenXRGL::TMatrix	matModel;
+		GLfloat		vDiffuse[4];
+		GLfloat		vCenter[3];
+		GLfloat		fRadius;
+		uint32_t	uMaterial;
+		uint32_t	uLevel;			// level of detail of this frame, the same for all views
+	};
+
+	struct SMaterial
+	{
+		GLfloat	vDiffuse[4];
+		bool	bDoubleSided;
+	};
+
+public:
+	CBenchmarkScene() = default;
+	CBenchmarkScene(const CBenchmarkScene&) = delete;
+	CBenchmarkScene& operator=(const CBenchmarkScene&) = delete;
+
+	~CBenchmarkScene()
+	{
+		release();
+	}
+
+	bool create(const SSceneConfig& rConfig, uint32_t uViewNum)
+	{
+		release();
+		m_mConfig = rConfig;
+		m_uRandom = rConfig.uSeed;
+
+		createMesh((std::max)(rConfig.uTrianglesPerObject, 8u));
+
+		// materials
+		m_vMaterials.resize((std::max)(rConfig.uMaterialNum, 1u));
+		for (auto& rMat : m_vMaterials)
+			rMat = { { 0.2f + 0.8f * random(), 0.2f + 0.8f * random(), 0.2f + 0.8f * random(), 1.0f }, random() < 0.5f };
+
+		// objects, grouped in runs so each view does exactly uStateChanges material switches
+		const uint32_t uRuns = (std::max)(1u, (std::min)(rConfig.uStateChanges, rConfig.uObjectNum));
+		m_vObjects.resize(rConfig.uObjectNum);
+		for (uint32_t i = 0; i < rConfig.uObjectNum; ++i)
+		{
+			SObject& rObj = m_vObjects[i];
+			rObj.uMaterial = (uint32_t)((uint64_t)i * uRuns / rConfig.uObjectNum) % m_vMaterials.size();
+			rObj.fRadius = 0.05f + 0.15f * random();
+			rObj.vCenter[0] = -5.0f + 10.0f * random();
+			rObj.vCenter[1] = -2.0f + 4.0f * random();
+			rObj.vCenter[2] = -5.0f + 10.0f * random();
+			std::copy(m_vMaterials[rObj.uMaterial].vDiffuse, m_vMaterials[rObj.uMaterial].vDiffuse + 4, rObj.vDiffuse);
+			rObj.uLevel = 0;
+			rObj.matModel = {
+				rObj.fRadius, 0, 0, 0,
+				0, rObj.fRadius, 0, 0,
+				0, 0, rObj.fRadius, 0,
+				rObj.vCenter[0], rObj.vCenter[1], rObj.vCenter[2], 1 };
+		}
+
+		m_vVisible.resize(uViewNum);
+
+		// full-view blended layers for overdraw
+		const char* sOverdrawVS = "#version 450 core\nvoid main(){ gl_Position = vec4(vec2((gl_VertexID << 1) & 2, gl_VertexID & 2) * 2.0 - 1.0, 0.0, 1.0); }";
+		const char* sOverdrawFS = "#version 450 core\nout vec4 outColor; void main(){ outColor = vec4(0.05, 0.05, 0.05, 0.1); }";
+		return m_mOverdrawProgram.build(sOverdrawVS, sOverdrawFS);
+	}
+
+	void release()
+	{
+		m_glVAO.reset();
+		m_glBuffers[0].reset();
+		m_glBuffers[1].reset();
+		m_mOverdrawProgram.release();
+		m_vObjects.clear();
+		m_vMaterials.clear();
+		m_vLevels.clear();
+	}
+
+	// Uniform ring size needed for one frame
+	GLsizeiptr uniformSizePerFrame(uint32_t uViewNum) const
+	{
+		return (GLsizeiptr)(m_vObjects.size() + 4) * uViewNum * 256 + 64 * 1024;
+	}
+
+	// CPU work of a view: cull objects against its frustum; thread safe for different views
+	void prepareView(uint32_t uViewIdx, const COpenXRGL::SViewInfo& rView, const COpenXRGL::TMatrix& matWorld)
+	{
+		COpenXRGL::SViewInfo mView = rView;
+		mView.matModelView = multiply(rView.matModelView, matWorld);
+
+		auto& rVisible = m_vVisible[uViewIdx];
+		rVisible.clear();
+		for (uint32_t i = 0; i < m_vObjects.size(); ++i)
+			if (isSphereInView(mView, m_vObjects[i].vCenter, m_vObjects[i].fRadius))
+				rVisible.push_back(i);
+	}
+
+	// Pick the level of detail of every object from its projected error in all views; call before drawView()
+	void selectLOD(const std::vector<COpenXRGL::SViewInfo>& vViews, const COpenXRGL::TMatrix& matWorld)
+	{
+		m_perfLOD.begin();
+		m_mLODSelector.setViews(vViews, matWorld);
+		for (auto& rObj : m_vObjects)
+			rObj.uLevel = m_mLODSelector.select(m_vLevels, rObj.vCenter, rObj.fRadius, rObj.fRadius);
+		m_perfLOD.end(m_vObjects.size());
+	}
+
+	CLODSelector& getLODSelector()
+	{
+		return m_mLODSelector;
+	}
+
+	// CPU time of selectLOD()
+	CPerfCounter& getLODCounter()
+	{
+		return m_perfLOD;
+	}
+
+	// Triangles submitted by drawView(), and how many they would be at full detail
+	uint64_t drawnTriangles() const
+	{
+		return m_uDrawnTriangles;
+	}
+
+	uint64_t fullDetailTriangles() const
+	{
+		return m_uFullTriangles;
+	}
+
+	void resetTriangleCount()
+	{
+		m_uDrawnTriangles = 0;
+		m_uFullTriangles = 0;
+	}
+
+	// Submit the visible objects of a view, the view constants must be bound already; return the number of draw calls.
+	// The blended overdraw layers are drawn separately by drawOverdraw(), after everything opaque like a sky.
+	template<size_t NUM_SEGMENTS>
+	uint32_t drawView(uint32_t uViewIdx, CGLUniformRing<NUM_SEGMENTS>& rRing)
+	{
+		uint32_t uDrawCalls = 0;
+		uint32_t uMaterial = (uint32_t)-1;
+
+		glBindVertexArray(m_glVAO);
+		for (const auto& uIdx : m_vVisible[uViewIdx])
+		{
+			const SObject& rObj = m_vObjects[uIdx];
+			if (rObj.uMaterial != uMaterial)
+			{
+				uMaterial = rObj.uMaterial;
+				if (m_vMaterials[uMaterial].bDoubleSided)
+					glDisable(GL_CULL_FACE);
+				else
+					glEnable(GL_CULL_FACE);
+			}
+
+			struct { COpenXRGL::TMatrix matModel; GLfloat vDiffuse[4]; } mConstants;
+			mConstants.matModel = rObj.matModel;
+			std::copy(rObj.vDiffuse, rObj.vDiffuse + 4, mConstants.vDiffuse);
+			rRing.bind(2, mConstants);
+
+			const SLODLevel& rLevel = m_vLevels[rObj.uLevel];
+			glDrawElementsBaseVertex(GL_TRIANGLES, rLevel.iIndexNum, GL_UNSIGNED_INT, (const void*)(rLevel.iFirstIndex * sizeof(GLuint)), rLevel.iBaseVertex);
+			m_uDrawnTriangles += rLevel.iIndexNum / 3;
+			m_uFullTriangles += m_vLevels[0].iIndexNum / 3;
+			++uDrawCalls;
+		}
+		glEnable(GL_CULL_FACE);
+		return uDrawCalls;
+	}
+
+	// Full-view blended layers over the view; return the number of draw calls
+	uint32_t drawOverdraw()
+	{
+		uint32_t uDrawCalls = 0;
+		if (m_mConfig.uOverdrawLayers > 0)
+		{
+			glDisable(GL_DEPTH_TEST);
+			glEnable(GL_BLEND);
+			glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+			glDisable(GL_CULL_FACE);
+			m_mOverdrawProgram.use();
+			for (uint32_t i = 0; i < m_mConfig.uOverdrawLayers; ++i)
+				glDrawArrays(GL_TRIANGLES, 0, 3);
+			uDrawCalls += m_mConfig.uOverdrawLayers;
+			glEnable(GL_CULL_FACE);
+			glDisable(GL_BLEND);
+			glEnable(GL_DEPTH_TEST);
+		}
+		return uDrawCalls;
+	}
+
+	const SSceneConfig& config() const
+	{
+		return m_mConfig;
+	}
+
+	GLsizei trianglesPerObject() const
+	{
+		return m_vLevels.empty() ? 0 : m_vLevels[0].iIndexNum / 3;
+	}
+
+	static COpenXRGL::TMatrix multiply(const COpenXRGL::TMatrix& a, const COpenXRGL::TMatrix& b)
+	{
+		COpenXRGL::TMatrix matResult;
+		for (int c = 0; c < 4; ++c)
+			for (int r = 0; r < 4; ++r)
+				matResult[c * 4 + r] = a[r] * b[c * 4] + a[4 + r] * b[c * 4 + 1] + a[8 + r] * b[c * 4 + 2] + a[12 + r] * b[c * 4 + 3];
+		return matResult;
+	}
+
+	// Conservative test of a bounding sphere against the asymmetric frustum of a view
+	static bool isSphereInView(const COpenXRGL::SViewInfo& rView, const GLfloat vCenter[3], GLfloat fRadius)
+	{
+		const auto& m = rView.matModelView;
+		const float x = m[0] * vCenter[0] + m[4] * vCenter[1] + m[8] * vCenter[2] + m[12];
+		const float y = m[1] * vCenter[0] + m[5] * vCenter[1] + m[9] * vCenter[2] + m[13];
+		const float d = -(m[2] * vCenter[0] + m[6] * vCenter[1] + m[10] * vCenter[2] + m[14]);
+		if (d + fRadius < 0.01f)
+			return false;
+
+		const float tL = tanf(rView.xrFov.angleLeft), tR = tanf(rView.xrFov.angleRight);
+		const float tD = tanf(rView.xrFov.angleDown), tU = tanf(rView.xrFov.angleUp);
+		return	x >= tL * d - fRadius * sqrtf(1 + tL * tL) &&
+				x <= tR * d + fRadius * sqrtf(1 + tR * tR) &&
+				y >= tD * d - fRadius * sqrtf(1 + tD * tD) &&
+				y <= tU * d + fRadius * sqrtf(1 + tU * tU);
+	}
+
+	// Rings of the UV sphere generateSphere() makes for about uTriangles triangles
+	static uint32_t sphereRings(uint32_t uTriangles)
+	{
+		return (std::max)(3u, (uint32_t)std::sqrt(uTriangles / 4.0));
+	}
+
+	// Unit UV sphere with about uTriangles triangles, same vertex layout as the cube (position, normal)
+	static void generateSphere(uint32_t uTriangles, std::vector<GLfloat>& vVertices, std::vector<GLuint>& vIndices)
+	{
+		const uint32_t uRings = sphereRings(uTriangles);
+		const uint32_t uSegments = uRings * 2;
+
+		vVertices.clear();
+		for (uint32_t r = 0; r <= uRings; ++r)
+		{
+			const float fTheta = 3.14159265f * r / uRings;
+			for (uint32_t s = 0; s <= uSegments; ++s)
+			{
+				const float fPhi = 6.2831853f * s / uSegments;
+				const float x = sinf(fTheta) * cosf(fPhi), y = cosf(fTheta), z = sinf(fTheta) * sinf(fPhi);
+				vVertices.insert(vVertices.end(), { x, y, z, x, y, z });
+			}
+		}
+
+		vIndices.clear();
+		for (uint32_t r = 0; r < uRings; ++r)
+		{
+			for (uint32_t s = 0; s < uSegments; ++s)
+			{
+				const GLuint a = r * (uSegments + 1) + s, b = a + uSegments + 1;
+				// clockwise seen from outside, as glFrontFace(GL_CW) of the cube
+				if (r != 0)
+					vIndices.insert(vIndices.end(), { a, b, a + 1 });
+				if (r != uRings - 1)
+					vIndices.insert(vIndices.end(), { a + 1, b, b + 1 });
+			}
+		}
+	}
+
+	// Spheres of uTriangles, 1/4, 1/16 ... of them, down to about 64 triangles and at most 5 levels, in one buffer.
+	// The error of a level is the largest gap between a facet and the unit sphere.
+	static void generateSphereLODs(uint32_t uTriangles, std::vector<GLfloat>& vVertices, std::vector<GLuint>& vIndices, std::vector<SLODLevel>& vLevels)
+	{
+		vVertices.clear();
+		vIndices.clear();
+		vLevels.clear();
+		uint32_t uRingsPrev = 0;
+		for (uint32_t uLevelTriangles = uTriangles; vLevels.size() < 5; uLevelTriangles /= 4)
+		{
+			const uint32_t uRings = sphereRings(uLevelTriangles);
+			if (uRings == uRingsPrev)
+				break;
+			uRingsPrev = uRings;
+
+			std::vector<GLfloat> vLevelVertices;
+			std::vector<GLuint> vLevelIndices;
+			generateSphere(uLevelTriangles, vLevelVertices, vLevelIndices);
+
+			// sagitta of an edge spanning pi / rings of the unit sphere
+			const float fHalfAngle = 3.14159265f / (2 * uRings);
+			vLevels.push_back({ (GLint)vIndices.size(), (GLsizei)vLevelIndices.size(), (GLint)(vVertices.size() / 6), 1.0f - cosf(fHalfAngle) });
+			vVertices.insert(vVertices.end(), vLevelVertices.begin(), vLevelVertices.end());
+			vIndices.insert(vIndices.end(), vLevelIndices.begin(), vLevelIndices.end());
+			if (uLevelTriangles < 128)
+				break;
+		}
+	}
+
+protected:
+	// Linear congruential generator, so the scene does not depend on the standard library implementation
+	float random()
+	{
+		m_uRandom = m_uRandom * 1664525u + 1013904223u;
+		return (m_uRandom >> 8) / 16777216.0f;
+	}
+
+	void createMesh(uint32_t uTriangles)
+	{
+		std::vector<GLfloat> vVertices;
+		std::vector<GLuint> vIndices;
+		generateSphereLODs(uTriangles, vVertices, vIndices, m_vLevels);
+
+		glCreateBuffers(1, m_glBuffers[0].put());
+		glCreateBuffers(1, m_glBuffers[1].put());
+		glNamedBufferStorage(m_glBuffers[0], vVertices.size() * sizeof(GLfloat), vVertices.data(), 0);
+		glNamedBufferStorage(m_glBuffers[1], vIndices.size() * sizeof(GLuint), vIndices.data(), 0);
+
+		glCreateVertexArrays(1, m_glVAO.put());
+		glVertexArrayVertexBuffer(m_glVAO, 0, m_glBuffers[0], 0, 6 * sizeof(GLfloat));
+		glVertexArrayElementBuffer(m_glVAO, m_glBuffers[1]);
+		glEnableVertexArrayAttrib(m_glVAO, 0);
+		glVertexArrayAttribFormat(m_glVAO, 0, 3, GL_FLOAT, GL_FALSE, 0);
+		glVertexArrayAttribBinding(m_glVAO, 0, 0);
+		glEnableVertexArrayAttrib(m_glVAO, 1);
+		glVertexArrayAttribFormat(m_glVAO, 1, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(GLfloat));
+		glVertexArrayAttribBinding(m_glVAO, 1, 0);
+	}
+
+protected:
+	SSceneConfig	m_mConfig;
+	uint32_t		m_uRandom = 1;
+
+	CGLVertexArray	m_glVAO;
+	CGLBuffer		m_glBuffers[2];		// vertex buffer, index buffer
+	std::vector<SLODLevel>	m_vLevels;
+	CLODSelector			m_mLODSelector;
+	CPerfCounter			m_perfLOD;
+	uint64_t	m_uDrawnTriangles = 0;
+	uint64_t	m_uFullTriangles = 0;
+
+	CGLProgram	m_mOverdrawProgram;
+
+	std::vector<SMaterial>	m_vMaterials;
+	std::vector<SObject>	m_vObjects;
+	std::vector<std::vector<uint32_t>>	m_vVisible;
+};
+
+// Collect per-frame measurements of a benchmark run and write them into a results file
+class CBenchmarkRecorder
+{
+public:
+	void beginFrame()
+	{
+		if (m_uFrames == 0)
+			m_tpStart = CPerfCounter::TClock::now();
+	}
+
+	void endFrame(double dCpuMs, double dGpuMs, uint32_t uDrawCalls)
+	{
+		++m_uFrames;
+		m_dCpuMs += dCpuMs;
+		m_dGpuMs += dGpuMs;
+		m_uDrawCalls += uDrawCalls;
+	}
+
+	uint64_t frames() const
+	{
+		return m_uFrames;
+	}
+
+	// Append one line to a CSV file, with a header if the file is new
+	bool write(const std::string& sFilename, const std::string& sLabel, const SSceneConfig& rConfig, uint32_t uViewNum) const
+	{
+		const double dSeconds = std::chrono::duration<double>(CPerfCounter::TClock::now() - m_tpStart).count();
+		const double dFrames = m_uFrames > 0 ? (double)m_uFrames : 1.0;
+
+		const bool bNew = !std::ifstream(sFilename).good();
+		std::ofstream fsOut(sFilename, std::ios::app);
+		if (!fsOut.is_open())
+		{
+			std::cout << "Error: can't write benchmark results to " << sFilename << std::endl;
+			return false;
+		}
+
+		if (bNew)
+			fsOut << "label,views,objects,triangles,materials,state_changes,overdraw,seed,frames,fps,cpu_ms,gpu_ms,draw_calls\n";
+		fsOut << sLabel << "," << uViewNum << "," << rConfig.uObjectNum << "," << rConfig.uTrianglesPerObject << ","
+			<< rConfig.uMaterialNum << "," << rConfig.uStateChanges << "," << rConfig.uOverdrawLayers << "," << rConfig.uSeed << ","
+			<< m_uFrames << "," << (dSeconds > 0 ? m_uFrames / dSeconds : 0.0) << ","
+			<< m_dCpuMs / dFrames << "," << m_dGpuMs / dFrames << "," << m_uDrawCalls / dFrames << "\n";
+
+		std::cout << "Benchmark results written to " << sFilename << std::endl;
+		return true;
+	}
+
+protected:
+	CPerfCounter::TClock::time_point	m_tpStart;
+	uint64_t	m_uFrames = 0;
+	uint64_t	m_uDrawCalls = 0;
+	double		m_dCpuMs = 0;
+	double		m_dGpuMs = 0;
+};
@@ -0,0 +1,390 @@
+#pragma once
+
+#include <GL/glew.h>
+
+#include "GLUniformRing.h"
+#include "OpenXRGL.h"
+#include "PerfCounter.h"
+#include "ThreadPool.h"
+
+// STD Header
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <vector>
+
+// Point light, std430 layout
+struct SPointLight
+{
+	float	vPosRadius[4];	// position in scene space, range
+	float	vColor[4];
+};
+
+// Constants to find the cluster of a fragment, std140 layout
+struct SClusterConstants
+{
+	COpenXRGL::TMatrix	matCluster;		// scene space to cluster space
+	float		vTangents[4];			// left, right, down, up
+	float		vDepth[4];				// near, slices / log(far / near), far
+	uint32_t	uGrid[4];				// x, y, z, light number
+};
+
+// Clustered forward lighting: point lights are assigned to a froxel grid built once per frame from the union frustum
+// of all views, so every eye shares one set of light lists. The fragment shader reads only the lights of its cluster:
+//   binding 3: SPointLight[], binding 4: uvec2 (offset, count) per cluster, binding 5: light indices
+class CClusteredLights
+{
+public:
+	static constexpr uint32_t GRID_X = 16;
+	static constexpr uint32_t GRID_Y = 9;
+	static constexpr uint32_t GRID_Z = 24;
+	static constexpr uint32_t CLUSTER_NUM = GRID_X * GRID_Y * GRID_Z;
+
+	// GLSL declarations and function to add the light of the clusters, to put after the #version line of a fragment shader
+	static const char* shaderSource()
+	{
+		return R"(
+layout(std430, binding = 3) readonly buffer LightBuffer { vec4 vLights[]; };
+layout(std430, binding = 4) readonly buffer ClusterBuffer { uvec2 uClusters[]; };
+layout(std430, binding = 5) readonly buffer IndexBuffer { uint uLightIndices[]; };
+
+vec3 clusteredLight(vec3 vPos, vec3 vN, vec3 vDiffuse, mat4 matCluster, vec4 vTangents, vec4 vDepth, uvec4 uGrid)
+{
+	vec4 vClusterPos = matCluster * vec4(vPos, 1.0);
+	float fDepth = -vClusterPos.z;
+	if (fDepth <= vDepth.x)
+		return vec3(0.0);
+
+	vec2 vTan = vClusterPos.xy / fDepth;
+	ivec3 iCell = ivec3(
+		floor((vTan.x - vTangents.x) / (vTangents.y - vTangents.x) * float(uGrid.x)),
+		floor((vTan.y - vTangents.z) / (vTangents.w - vTangents.z) * float(uGrid.y)),
+		floor(log(fDepth / vDepth.x) * vDepth.y));
+	if (any(lessThan(iCell, ivec3(0))) || any(greaterThanEqual(iCell, ivec3(uGrid.xyz))))
+		return vec3(0.0);
+
+	uvec2 uCluster = uClusters[(uint(iCell.z) * uGrid.y + uint(iCell.y)) * uGrid.x + uint(iCell.x)];
+	vec3 vColor = vec3(0.0);
+	for (uint i = 0; i < uCluster.y; ++i)
+	{
+		uint uLight = uLightIndices[uCluster.x + i];
+		vec4 vPosRadius = vLights[uLight * 2];
+		vec3 vL = vPosRadius.xyz - vPos;
+		float fDist = length(vL);
+		float fAtten = clamp(1.0 - fDist / vPosRadius.w, 0.0, 1.0);
+		vColor += vDiffuse * vLights[uLight * 2 + 1].rgb * max(dot(vN, vL / max(fDist, 1e-4)), 0.0) * fAtten * fAtten;
+	}
+	return vColor;
+}
+)";
+	}
+
+public:
+	CClusteredLights() = default;
+	CClusteredLights(const CClusteredLights&) = delete;
+	CClusteredLights& operator=(const CClusteredLights&) = delete;
+
+	// uMaxLights sizes the per-frame buffers; rThreadPool runs the light assignment, it must outlive this object
+	bool create(CThreadPool& rThreadPool, uint32_t uMaxLights, float fFar = 20.0f)
+	{
+		m_pThreadPool = &rThreadPool;
+		m_uMaxLights = (std::max)(uMaxLights, 1u);
+		m_uMaxIndices = (std::max)(m_uMaxLights * 64, CLUSTER_NUM);
+		m_fFar = fFar;
+		m_vClusterLists.resize(CLUSTER_NUM);
+		m_vGrid.resize(CLUSTER_NUM * 2);
+
+		// 3 buffers per frame, each aligned by the ring
+		const GLsizeiptr uSize = m_uMaxLights * sizeof(SPointLight) + m_vGrid.size() * sizeof(uint32_t) + m_uMaxIndices * sizeof(uint32_t) + 3 * 256;
+		return m_mRing.create(uSize, GL_SHADER_STORAGE_BUFFER);
+	}
+
+	void release()
+	{
+		m_mRing.release();
+		m_vLights.clear();
+	}
+
+	void setLights(const std::vector<SPointLight>& vLights)
+	{
+		m_vLights.assign(vLights.begin(), vLights.begin() + (std::min)(vLights.size(), (size_t)m_uMaxLights));
+	}
+
+	// uNum lights of random color in a box, with a range that keeps about the same number of lights per cluster
+	static std::vector<SPointLight> generate(uint32_t uNum, uint32_t uSeed, const float vMin[3], const float vMax[3])
+	{
+		uint32_t uRandom = uSeed;
+		auto random = [&uRandom]() {
+			uRandom = uRandom * 1664525u + 1013904223u;
+			return (uRandom >> 8) / 16777216.0f;
+		};
+
+		const float fRadius = (std::max)(0.5f, (std::min)(4.0f, 4.0f / std::cbrt(uNum / 8.0f)));
+		std::vector<SPointLight> vLights(uNum);
+		for (auto& rLight : vLights)
+		{
+			for (int i = 0; i < 3; ++i)
+				rLight.vPosRadius[i] = vMin[i] + (vMax[i] - vMin[i]) * random();
+			rLight.vPosRadius[3] = fRadius;
+			rLight.vColor[0] = 0.2f + 0.8f * random();
+			rLight.vColor[1] = 0.2f + 0.8f * random();
+			rLight.vColor[2] = 0.2f + 0.8f * random();
+			rLight.vColor[3] = 1;
+		}
+		return vLights;
+	}
+
+	// Build the union frustum of the views and assign the lights to its clusters, then upload and bind the buffers.
+	// vViewMatrices: scene space to eye space of each view, as the shader uses them.
+	void update(const std::vector<COpenXRGL::SViewInfo>& vViews, const std::vector<COpenXRGL::TMatrix>& vViewMatrices)
+	{
+		m_perfAssign.begin();
+		buildFrustum(vViews, vViewMatrices);
+		assignLights();
+		m_perfAssign.end(m_vLights.size());
+
+		m_mRing.beginFrame();
+		if (!m_vLights.empty())
+			m_mRing.bind(3, m_vLights.data(), m_vLights.size() * sizeof(SPointLight));
+		else
+			m_mRing.bind(3, m_mConstants.uGrid, sizeof(m_mConstants.uGrid));	// never read, but keep the binding valid
+		m_mRing.bind(4, m_vGrid.data(), m_vGrid.size() * sizeof(uint32_t));
+		m_mRing.bind(5, m_vIndices.data(), (std::max)(m_vIndices.size(), (size_t)1) * sizeof(uint32_t));
+	}
+
+	// After the last draw call that reads the buffers of this frame
+	void endFrame()
+	{
+		m_mRing.endFrame();
+	}
+
+	const SClusterConstants& constants() const
+	{
+		return m_mConstants;
+	}
+
+	size_t lightCount() const
+	{
+		return m_vLights.size();
+	}
+
+	// CPU time of update(), and the light references that did not fit into the index buffer
+	CPerfCounter& getAssignCounter()
+	{
+		return m_perfAssign;
+	}
+
+	uint64_t droppedIndices() const
+	{
+		return m_uDropped;
+	}
+
+	double lightsPerCluster() const
+	{
+		return (double)m_vIndices.size() / CLUSTER_NUM;
+	}
+
+protected:
+	struct SLightBounds
+	{
+		int	iMin[3];
+		int	iMax[3];	// empty when iMin > iMax
+	};
+
+	static void transformPoint(const COpenXRGL::TMatrix& m, const float* v, float* vOut)
+	{
+		for (int i = 0; i < 3; ++i)
+			vOut[i] = m[i] * v[0] + m[4 + i] * v[1] + m[8 + i] * v[2] + m[12 + i];
+	}
+
+	static void transformVector(const COpenXRGL::TMatrix& m, const float* v, float* vOut)
+	{
+		for (int i = 0; i < 3; ++i)
+			vOut[i] = m[i] * v[0] + m[4 + i] * v[1] + m[8 + i] * v[2];
+	}
+
+	// Inverse of a rotation and translation
+	static COpenXRGL::TMatrix rigidInverse(const COpenXRGL::TMatrix& m)
+	{
+		COpenXRGL::TMatrix r = {
+			m[0], m[4], m[8], 0,
+			m[1], m[5], m[9], 0,
+			m[2], m[6], m[10], 0,
+			0, 0, 0, 1 };
+		for (int i = 0; i < 3; ++i)
+			r[12 + i] = -(r[i] * m[12] + r[4 + i] * m[13] + r[8 + i] * m[14]);
+		return r;
+	}
+
+	static COpenXRGL::TMatrix multiply(const COpenXRGL::TMatrix& a, const COpenXRGL::TMatrix& b)
+	{
+		COpenXRGL::TMatrix r;
+		for (int c = 0; c < 4; ++c)
+			for (int i = 0; i < 4; ++i)
+				r[c * 4 + i] = a[i] * b[c * 4] + a[4 + i] * b[c * 4 + 1] + a[8 + i] * b[c * 4 + 2] + a[12 + i] * b[c * 4 + 3];
+		return r;
+	}
+
+	// In the space of the first view: the union of the view frustums, from a point behind the eyes that sees all of them
+	void buildFrustum(const std::vector<COpenXRGL::SViewInfo>& vViews, const std::vector<COpenXRGL::TMatrix>& vViewMatrices)
+	{
+		const size_t uViewNum = (std::min)(vViews.size(), vViewMatrices.size());
+		if (uViewNum == 0)
+			return;
+
+		float fLeft = 0, fRight = 0, fDown = 0, fUp = 0;
+		std::vector<std::array<float, 3>> vEyes(uViewNum);
+		float vCenter[3] = { 0, 0, 0 };
+		for (size_t v = 0; v < uViewNum; ++v)
+		{
+			const COpenXRGL::TMatrix matToFirst = multiply(vViewMatrices[0], rigidInverse(vViewMatrices[v]));
+			const float vZero[3] = { 0, 0, 0 };
+			transformPoint(matToFirst, vZero, vEyes[v].data());
+			for (int i = 0; i < 3; ++i)
+				vCenter[i] += vEyes[v][i] / uViewNum;
+
+			const XrFovf& rFov = vViews[v].xrFov;
+			const float aTanX[2] = { tanf(rFov.angleLeft), tanf(rFov.angleRight) };
+			const float aTanY[2] = { tanf(rFov.angleDown), tanf(rFov.angleUp) };
+			for (const float fTanX : aTanX)
+			{
+				for (const float fTanY : aTanY)
+				{
+					const float vCorner[3] = { fTanX, fTanY, -1 };
+					float vDir[3];
+					transformVector(matToFirst, vCorner, vDir);
+					const float fZ = (std::max)(-vDir[2], 0.05f);	// canted views further than 90 degrees are clamped
+					const float fX = vDir[0] / fZ, fY = vDir[1] / fZ;
+					const bool bFirst = v == 0 && fTanX == aTanX[0] && fTanY == aTanY[0];
+					fLeft = bFirst ? fX : (std::min)(fLeft, fX);
+					fRight = bFirst ? fX : (std::max)(fRight, fX);
+					fDown = bFirst ? fY : (std::min)(fDown, fY);
+					fUp = bFirst ? fY : (std::max)(fUp, fY);
+				}
+			}
+		}
+
+		// the eyes are around the center axis, so the union must straddle it for moving back to bring every eye inside;
+		// a one-sided field of view, like a single off-axis view, is widened to the axis
+		fLeft = (std::min)(fLeft, -0.05f);
+		fRight = (std::max)(fRight, 0.05f);
+		fDown = (std::min)(fDown, -0.05f);
+		fUp = (std::max)(fUp, 0.05f);
+
+		// move back until every eye is inside the union frustum
+		float fBack = 0;
+		for (const auto& rEye : vEyes)
+		{
+			const float dx = rEye[0] - vCenter[0], dy = rEye[1] - vCenter[1], dz = rEye[2] - vCenter[2];
+			fBack = (std::max)(fBack, dx > 0 ? dx / fRight : dx / fLeft);
+			fBack = (std::max)(fBack, dy > 0 ? dy / fUp : dy / fDown);
+			fBack = (std::max)(fBack, dz);
+		}
+
+		const COpenXRGL::TMatrix matTranslate = {
+			1, 0, 0, 0,
+			0, 1, 0, 0,
+			0, 0, 1, 0,
+			-vCenter[0], -vCenter[1], -(vCenter[2] + fBack), 1 };
+		m_mConstants.matCluster = multiply(matTranslate, vViewMatrices[0]);
+
+		const float fNear = 0.05f + fBack;
+		const float fFar = (std::max)(m_fFar, fNear * 2);
+		m_mConstants.vTangents[0] = fLeft;
+		m_mConstants.vTangents[1] = fRight;
+		m_mConstants.vTangents[2] = fDown;
+		m_mConstants.vTangents[3] = fUp;
+		m_mConstants.vDepth[0] = fNear;
+		m_mConstants.vDepth[1] = GRID_Z / logf(fFar / fNear);
+		m_mConstants.vDepth[2] = fFar;
+		m_mConstants.vDepth[3] = 0;
+		m_mConstants.uGrid[0] = GRID_X;
+		m_mConstants.uGrid[1] = GRID_Y;
+		m_mConstants.uGrid[2] = GRID_Z;
+		m_mConstants.uGrid[3] = (uint32_t)m_vLights.size();
+	}
+
+	// Conservative cell range of a light sphere
+	SLightBounds computeBounds(const SPointLight& rLight) const
+	{
+		SLightBounds mBounds = { { 0, 0, 0 }, { -1, -1, -1 } };
+
+		float vPos[3];
+		transformPoint(m_mConstants.matCluster, rLight.vPosRadius, vPos);
+		const float fRadius = rLight.vPosRadius[3];
+		const float fNear = m_mConstants.vDepth[0], fFar = m_mConstants.vDepth[2];
+		const float fDepthMin = (std::max)(-vPos[2] - fRadius, fNear), fDepthMax = (std::min)(-vPos[2] + fRadius, fFar);
+		if (fDepthMin > fDepthMax)
+			return mBounds;
+
+		// x / depth is monotonic in depth for a fixed x, so the extremes are at the depth range ends
+		auto cellRange = [&](float fLow, float fHigh, float fTanMin, float fTanMax, int iCells, int& iMin, int& iMax) {
+			const float fMin = (std::min)(fLow / fDepthMin, fLow / fDepthMax), fMax = (std::max)(fHigh / fDepthMin, fHigh / fDepthMax);
+			iMin = (std::max)(0, (int)floorf((fMin - fTanMin) / (fTanMax - fTanMin) * iCells));
+			iMax = (std::min)(iCells - 1, (int)floorf((fMax - fTanMin) / (fTanMax - fTanMin) * iCells));
+		};
+		cellRange(vPos[0] - fRadius, vPos[0] + fRadius, m_mConstants.vTangents[0], m_mConstants.vTangents[1], GRID_X, mBounds.iMin[0], mBounds.iMax[0]);
+		cellRange(vPos[1] - fRadius, vPos[1] + fRadius, m_mConstants.vTangents[2], m_mConstants.vTangents[3], GRID_Y, mBounds.iMin[1], mBounds.iMax[1]);
+		mBounds.iMin[2] = (std::max)(0, (int)floorf(logf(fDepthMin / fNear) * m_mConstants.vDepth[1]));
+		mBounds.iMax[2] = (std::min)((int)GRID_Z - 1, (int)floorf(logf(fDepthMax / fNear) * m_mConstants.vDepth[1]));
+		return mBounds;
+	}
+
+	// Bounds per light, then lists per depth slice, in parallel; each slice only writes its own clusters
+	void assignLights()
+	{
+		const size_t uLightNum = m_vLights.size();
+		m_vBounds.resize(uLightNum);
+		const size_t uChunk = 256;
+		m_pThreadPool->parallelFor((uLightNum + uChunk - 1) / uChunk, [&](size_t c) {
+			for (size_t l = c * uChunk; l < (std::min)(uLightNum, (c + 1) * uChunk); ++l)
+				m_vBounds[l] = computeBounds(m_vLights[l]);
+		});
+
+		m_pThreadPool->parallelFor(GRID_Z, [&](size_t z) {
+			for (uint32_t i = 0; i < GRID_X * GRID_Y; ++i)
+				m_vClusterLists[z * GRID_X * GRID_Y + i].clear();
+
+			for (uint32_t l = 0; l < uLightNum; ++l)
+			{
+				const SLightBounds& rBounds = m_vBounds[l];
+				if ((int)z < rBounds.iMin[2] || (int)z > rBounds.iMax[2])
+					continue;
+
+				for (int y = rBounds.iMin[1]; y <= rBounds.iMax[1]; ++y)
+					for (int x = rBounds.iMin[0]; x <= rBounds.iMax[0]; ++x)
+						m_vClusterLists[(z * GRID_Y + y) * GRID_X + x].push_back(l);
+			}
+		});
+
+		// flatten into (offset, count) and one index list
+		m_vIndices.clear();
+		m_uDropped = 0;
+		for (uint32_t i = 0; i < CLUSTER_NUM; ++i)
+		{
+			const auto& rList = m_vClusterLists[i];
+			const size_t uCount = (std::min)(rList.size(), m_uMaxIndices - m_vIndices.size());
+			m_vGrid[i * 2] = (uint32_t)m_vIndices.size();
+			m_vGrid[i * 2 + 1] = (uint32_t)uCount;
+			m_vIndices.insert(m_vIndices.end(), rList.begin(), rList.begin() + uCount);
+			m_uDropped += rList.size() - uCount;
+		}
+	}
+
+protected:
+	uint32_t	m_uMaxLights = 0;
+	size_t		m_uMaxIndices = 0;
+	float		m_fFar = 20.0f;
+
+	std::vector<SPointLight>			m_vLights;
+	std::vector<SLightBounds>			m_vBounds;
+	std::vector<std::vector<uint32_t>>	m_vClusterLists;
+	std::vector<uint32_t>				m_vGrid;
+	std::vector<uint32_t>				m_vIndices;
+	uint64_t							m_uDropped = 0;
+
+	SClusterConstants				m_mConstants = {};
+	CGLUniformRing<3>				m_mRing;
+	CThreadPool*					m_pThreadPool = nullptr;
+	CPerfCounter					m_perfAssign;
+};
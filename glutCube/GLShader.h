@@ -0,0 +1,226 @@
+#pragma once
+
+// Windows Header
+#include <Windows.h>
+
+#include <GL/glew.h>
+
+// STD Header
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+class CGLProgram
+{
+public:
+	// Program binaries of the last run, keyed by the shader sources and the GL driver
+	struct SBinaryCache
+	{
+		std::string	sDirectory;		// empty: disabled
+		uint32_t	uHits = 0;
+		uint32_t	uMisses = 0;
+	};
+
+	// Save linked programs into sDirectory and load them from there instead of compiling on the next run
+	static void setBinaryCache(const std::string& sDirectory)
+	{
+		if (!sDirectory.empty())
+			CreateDirectoryA(sDirectory.c_str(), nullptr);
+		binaryCache().sDirectory = sDirectory;
+	}
+
+	static SBinaryCache& binaryCache()
+	{
+		static SBinaryCache s_mCache;
+		return s_mCache;
+	}
+
+public:
+	CGLProgram() = default;
+	CGLProgram(const CGLProgram&) = delete;
+	CGLProgram& operator=(const CGLProgram&) = delete;
+
+	~CGLProgram()
+	{
+		release();
+	}
+
+	bool build(const std::string& sVertexShader, const std::string& sFragmentShader)
+	{
+		release();
+
+		const std::string sCacheFile = getCacheFile(sVertexShader, sFragmentShader);
+		if (!sCacheFile.empty())
+		{
+			if (loadBinary(sCacheFile))
+			{
+				++binaryCache().uHits;
+				return true;
+			}
+			++binaryCache().uMisses;
+		}
+
+		GLuint uVS = compile(GL_VERTEX_SHADER, sVertexShader);
+		GLuint uFS = compile(GL_FRAGMENT_SHADER, sFragmentShader);
+		if (uVS == 0 || uFS == 0)
+		{
+			glDeleteShader(uVS);
+			glDeleteShader(uFS);
+			return false;
+		}
+
+		m_glProgram = glCreateProgram();
+		if (!sCacheFile.empty())
+			glProgramParameteri(m_glProgram, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+		glAttachShader(m_glProgram, uVS);
+		glAttachShader(m_glProgram, uFS);
+		glLinkProgram(m_glProgram);
+		glDeleteShader(uVS);
+		glDeleteShader(uFS);
+
+		GLint iStatus = GL_FALSE;
+		glGetProgramiv(m_glProgram, GL_LINK_STATUS, &iStatus);
+		if (iStatus != GL_TRUE)
+		{
+			std::cout << "Error: program link failed\n  " << getLog(m_glProgram, false) << std::endl;
+			release();
+			return false;
+		}
+
+		if (!sCacheFile.empty())
+			saveBinary(sCacheFile);
+		return true;
+	}
+
+	void release()
+	{
+		if (m_glProgram != 0)
+		{
+			glDeleteProgram(m_glProgram);
+			m_glProgram = 0;
+		}
+	}
+
+	void use() const
+	{
+		glUseProgram(m_glProgram);
+	}
+
+	GLuint id() const
+	{
+		return m_glProgram;
+	}
+
+protected:
+	// Empty when the cache is disabled or the driver has no binary format
+	static std::string getCacheFile(const std::string& sVertexShader, const std::string& sFragmentShader)
+	{
+		if (binaryCache().sDirectory.empty())
+			return "";
+
+		GLint iFormatNum = 0;
+		glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &iFormatNum);
+		if (iFormatNum <= 0)
+			return "";
+
+		// FNV-1a of the sources, vendor, renderer and version; a new driver gets new files
+		uint64_t uHash = 14695981039346656037ull;
+		auto hash = [&uHash](const char* pText) {
+			for (; pText != nullptr && *pText != '\0'; ++pText)
+				uHash = (uHash ^ (uint8_t)*pText) * 1099511628211ull;
+			uHash = (uHash ^ 0xff) * 1099511628211ull;
+		};
+		hash(sVertexShader.c_str());
+		hash(sFragmentShader.c_str());
+		for (const GLenum eName : { GL_VENDOR, GL_RENDERER, GL_VERSION })
+			hash((const char*)glGetString(eName));
+
+		char sName[32];
+		snprintf(sName, sizeof(sName), "%016llx.bin", (unsigned long long)uHash);
+		return binaryCache().sDirectory + "/" + sName;
+	}
+
+	// A binary the driver rejects is compiled again and overwritten
+	bool loadBinary(const std::string& sFile)
+	{
+		std::ifstream fsIn(sFile, std::ios::binary);
+		GLenum eFormat = 0;
+		if (!fsIn.read((char*)&eFormat, sizeof(eFormat)))
+			return false;
+		const std::vector<char> vData((std::istreambuf_iterator<char>(fsIn)), std::istreambuf_iterator<char>());
+		if (vData.empty())
+			return false;
+
+		m_glProgram = glCreateProgram();
+		glProgramBinary(m_glProgram, eFormat, vData.data(), (GLsizei)vData.size());
+		GLint iStatus = GL_FALSE;
+		glGetProgramiv(m_glProgram, GL_LINK_STATUS, &iStatus);
+		if (iStatus != GL_TRUE)
+		{
+			release();
+			return false;
+		}
+		return true;
+	}
+
+	void saveBinary(const std::string& sFile) const
+	{
+		GLint iLength = 0;
+		glGetProgramiv(m_glProgram, GL_PROGRAM_BINARY_LENGTH, &iLength);
+		if (iLength <= 0)
+			return;
+
+		std::vector<char> vData(iLength);
+		GLenum eFormat = 0;
+		glGetProgramBinary(m_glProgram, iLength, nullptr, &eFormat, vData.data());
+
+		std::ofstream fsOut(sFile, std::ios::binary);
+		fsOut.write((const char*)&eFormat, sizeof(eFormat));
+		fsOut.write(vData.data(), vData.size());
+		if (!fsOut)
+			std::cout << "Warning: can't write program binary " << sFile << std::endl;
+	}
+
+	static GLuint compile(GLenum eType, const std::string& sSource)
+	{
+		GLuint uShader = glCreateShader(eType);
+		const char* pSource = sSource.c_str();
+		glShaderSource(uShader, 1, &pSource, nullptr);
+		glCompileShader(uShader);
+
+		GLint iStatus = GL_FALSE;
+		glGetShaderiv(uShader, GL_COMPILE_STATUS, &iStatus);
+		if (iStatus != GL_TRUE)
+		{
+			std::cout << "Error: shader compile failed\n  " << getLog(uShader, true) << std::endl;
+			glDeleteShader(uShader);
+			return 0;
+		}
+		return uShader;
+	}
+
+	static std::string getLog(GLuint uObject, bool bShader)
+	{
+		GLint iLength = 0;
+		if (bShader)
+			glGetShaderiv(uObject, GL_INFO_LOG_LENGTH, &iLength);
+		else
+			glGetProgramiv(uObject, GL_INFO_LOG_LENGTH, &iLength);
+
+		if (iLength <= 0)
+			return "";
+
+		std::vector<char> vLog(iLength);
+		if (bShader)
+			glGetShaderInfoLog(uObject, iLength, nullptr, vLog.data());
+		else
+			glGetProgramInfoLog(uObject, iLength, nullptr, vLog.data());
+		return vLog.data();
+	}
+
+protected:
+	GLuint	m_glProgram = 0;
+};
@@ -0,0 +1,138 @@
+#pragma once
+
+#include <GL/glew.h>
+
+#include "Handle.h"
+
+// STD Header
+#include <array>
+#include <cstring>
+#include <iostream>
+
+// A persistently mapped uniform buffer split into N segments, one per frame in flight.
+// Each frame writes its constants into its own segment with plain memcpy, and a fence
+// keeps the CPU from overwriting a segment the GPU has not consumed yet.
+template<size_t NUM_SEGMENTS = 3>
+class CGLUniformRing
+{
+public:
+	CGLUniformRing() = default;
+	CGLUniformRing(const CGLUniformRing&) = delete;
+	CGLUniformRing& operator=(const CGLUniformRing&) = delete;
+
+	~CGLUniformRing()
+	{
+		release();
+	}
+
+	bool create(GLsizeiptr uSegmentSize, GLenum eTarget = GL_UNIFORM_BUFFER)
+	{
+		release();
+
+		m_eTarget = eTarget;
+		GLint iAlignment = 256;
+		glGetIntegerv(eTarget == GL_SHADER_STORAGE_BUFFER ? GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT : GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &iAlignment);
+		m_uAlignment = iAlignment > 0 ? iAlignment : 256;
+		m_uSegmentSize = alignUp(uSegmentSize);
+
+		const GLbitfield uFlags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+		glCreateBuffers(1, m_glBuffer.put());
+		glNamedBufferStorage(m_glBuffer, m_uSegmentSize * NUM_SEGMENTS, nullptr, uFlags);
+		m_pMapped = static_cast<char*>(glMapNamedBufferRange(m_glBuffer, 0, m_uSegmentSize * NUM_SEGMENTS, uFlags));
+		if (m_pMapped == nullptr)
+		{
+			std::cout << "Error: failed to map uniform ring buffer" << std::endl;
+			release();
+			return false;
+		}
+		return true;
+	}
+
+	void release()
+	{
+		for (auto& rFence : m_aFences)
+		{
+			if (rFence != nullptr)
+			{
+				glDeleteSync(rFence);
+				rFence = nullptr;
+			}
+		}
+
+		if (m_glBuffer && m_pMapped != nullptr)
+			glUnmapNamedBuffer(m_glBuffer);
+		m_glBuffer.reset();
+		m_pMapped = nullptr;
+	}
+
+	// Wait until the GPU released the segment of this frame, then start writing from its head
+	void beginFrame()
+	{
+		GLsync& rFence = m_aFences[m_uSegment];
+		if (rFence != nullptr)
+		{
+			GLbitfield uFlags = 0;
+			while (true)
+			{
+				GLenum eRes = glClientWaitSync(rFence, uFlags, 1000000);
+				if (eRes == GL_ALREADY_SIGNALED || eRes == GL_CONDITION_SATISFIED || eRes == GL_WAIT_FAILED)
+					break;
+				uFlags = GL_SYNC_FLUSH_COMMANDS_BIT;
+			}
+			glDeleteSync(rFence);
+			rFence = nullptr;
+		}
+		m_uOffset = 0;
+	}
+
+	void endFrame()
+	{
+		m_aFences[m_uSegment] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+		m_uSegment = (m_uSegment + 1) % NUM_SEGMENTS;
+	}
+
+	// Copy rData into the current segment and bind it to uBinding
+	template<typename TData>
+	bool bind(GLuint uBinding, const TData& rData)
+	{
+		return bind(uBinding, &rData, sizeof(TData));
+	}
+
+	bool bind(GLuint uBinding, const void* pData, GLsizeiptr uSize)
+	{
+		if (m_uOffset + uSize > m_uSegmentSize)
+		{
+			std::cout << "Error: uniform ring segment overflow" << std::endl;
+			return false;
+		}
+
+		const GLintptr uOffset = m_uSegment * m_uSegmentSize + m_uOffset;
+		std::memcpy(m_pMapped + uOffset, pData, uSize);
+		glBindBufferRange(m_eTarget, uBinding, m_glBuffer, uOffset, uSize);
+
+		m_uOffset += alignUp(uSize);
+		return true;
+	}
+
+	GLsizeiptr usedSize() const
+	{
+		return m_uOffset;
+	}
+
+protected:
+	GLsizeiptr alignUp(GLsizeiptr uSize) const
+	{
+		return (uSize + m_uAlignment - 1) / m_uAlignment * m_uAlignment;
+	}
+
+protected:
+	CGLBuffer	m_glBuffer;
+	GLenum		m_eTarget = GL_UNIFORM_BUFFER;
+	char*		m_pMapped = nullptr;
+	GLsizeiptr	m_uAlignment = 256;
+	GLsizeiptr	m_uSegmentSize = 0;
+	GLsizeiptr	m_uOffset = 0;
+	size_t		m_uSegment = 0;
+
+	std::array<GLsync, NUM_SEGMENTS>	m_aFences{};
+};
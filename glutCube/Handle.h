@@ -0,0 +1,134 @@
+#pragma once
+
+#include <openxr/openxr.h>
+#include <GL/glew.h>
+
+// STD Header
+#include <utility>
+
+// Move-only owner of an OpenXR or OpenGL handle, destroyed by TDeleter when it goes out of scope
+template<typename THandle, typename TDeleter>
+class CHandle
+{
+public:
+	CHandle() = default;
+
+	explicit CHandle(THandle hHandle) : m_hHandle(hHandle)
+	{
+	}
+
+	CHandle(const CHandle&) = delete;
+	CHandle& operator=(const CHandle&) = delete;
+
+	CHandle(CHandle&& rOther) noexcept : m_hHandle(rOther.m_hHandle)
+	{
+		rOther.m_hHandle = THandle{};
+	}
+
+	CHandle& operator=(CHandle&& rOther) noexcept
+	{
+		if (this != &rOther)
+		{
+			reset();
+			std::swap(m_hHandle, rOther.m_hHandle);
+		}
+		return *this;
+	}
+
+	~CHandle()
+	{
+		reset();
+	}
+
+	THandle get() const
+	{
+		return m_hHandle;
+	}
+
+	operator THandle() const
+	{
+		return m_hHandle;
+	}
+
+	explicit operator bool() const
+	{
+		return m_hHandle != THandle{};
+	}
+
+	// Destroy the current handle and return the address to receive a new one
+	THandle* put()
+	{
+		reset();
+		return &m_hHandle;
+	}
+
+	void reset(THandle hHandle = THandle{})
+	{
+		if (m_hHandle != THandle{})
+			TDeleter()(m_hHandle);
+		m_hHandle = hHandle;
+	}
+
+protected:
+	THandle	m_hHandle{};
+};
+
+#pragma region OpenXR handles
+struct SXrInstanceDeleter
+{
+	void operator()(XrInstance xrHandle) const { xrDestroyInstance(xrHandle); }
+};
+
+struct SXrSessionDeleter
+{
+	void operator()(XrSession xrHandle) const { xrDestroySession(xrHandle); }
+};
+
+struct SXrSpaceDeleter
+{
+	void operator()(XrSpace xrHandle) const { xrDestroySpace(xrHandle); }
+};
+
+struct SXrSwapchainDeleter
+{
+	void operator()(XrSwapchain xrHandle) const { xrDestroySwapchain(xrHandle); }
+};
+
+using CXrInstance	= CHandle<XrInstance, SXrInstanceDeleter>;
+using CXrSession	= CHandle<XrSession, SXrSessionDeleter>;
+using CXrSpace		= CHandle<XrSpace, SXrSpaceDeleter>;
+using CXrSwapchain	= CHandle<XrSwapchain, SXrSwapchainDeleter>;
+#pragma endregion
+
+#pragma region OpenGL handles
+struct SGLFramebufferDeleter
+{
+	void operator()(GLuint glHandle) const { glDeleteFramebuffers(1, &glHandle); }
+};
+
+struct SGLBufferDeleter
+{
+	void operator()(GLuint glHandle) const { glDeleteBuffers(1, &glHandle); }
+};
+
+struct SGLTextureDeleter
+{
+	void operator()(GLuint glHandle) const { glDeleteTextures(1, &glHandle); }
+};
+
+struct SGLRenderbufferDeleter
+{
+	void operator()(GLuint glHandle) const { glDeleteRenderbuffers(1, &glHandle); }
+};
+
+struct SGLVertexArrayDeleter
+{
+	void operator()(GLuint glHandle) const { glDeleteVertexArrays(1, &glHandle); }
+};
+
+using CGLFramebuffer	= CHandle<GLuint, SGLFramebufferDeleter>;
+using CGLBuffer			= CHandle<GLuint, SGLBufferDeleter>;
+using CGLTexture		= CHandle<GLuint, SGLTextureDeleter>;
+using CGLRenderbuffer	= CHandle<GLuint, SGLRenderbufferDeleter>;
+using CGLVertexArray	= CHandle<GLuint, SGLVertexArrayDeleter>;
+#pragma endregion
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <GL/glew.h>
+
+#include "OpenXRGL.h"
+
+// STD Header
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+// One level of detail of a mesh: an index range in a shared index buffer, drawn with glDrawElementsBaseVertex
+struct SLODLevel
+{
+	GLint	iFirstIndex;
+	GLsizei	iIndexNum;
+	GLint	iBaseVertex;
+	float	fError;			// largest distance to the full detail surface, in object units
+};
+
+// Pick a level per instance from its projected error in pixels. All views are tested and the coarsest level that is
+// below the threshold in every view is used, so both eyes always see the same geometry.
+class CLODSelector
+{
+public:
+	// Pixels of error that are accepted; 0 keeps the full detail
+	void setThreshold(float fPixels)
+	{
+		m_fThreshold = fPixels;
+	}
+
+	float getThreshold() const
+	{
+		return m_fThreshold;
+	}
+
+	// Located views of this frame, matWorld transforms the instances into the space of the views
+	void setViews(const std::vector<COpenXRGL::SViewInfo>& vViews, const COpenXRGL::TMatrix& matWorld)
+	{
+		m_vViews.resize(vViews.size());
+		for (size_t i = 0; i < vViews.size(); ++i)
+		{
+			const COpenXRGL::SViewInfo& rView = vViews[i];
+			SView& rData = m_vViews[i];
+
+			// scene space to eye space, only the rows to get the eye position of a point are kept
+			const auto& a = rView.matModelView;
+			for (int c = 0; c < 4; ++c)
+				for (int r = 0; r < 3; ++r)
+					rData.vMatrix[c * 3 + r] = a[r] * matWorld[c * 4] + a[4 + r] * matWorld[c * 4 + 1] + a[8 + r] * matWorld[c * 4 + 2] + a[12 + r] * matWorld[c * 4 + 3];
+
+			// pixels covered by one unit at distance 1, the denser axis of the view
+			const XrFovf& rFov = rView.xrFov;
+			rData.fPixelsPerTangent = (std::max)(
+				rView.uWidth / (tanf(rFov.angleRight) - tanf(rFov.angleLeft)),
+				rView.uHeight / (tanf(rFov.angleUp) - tanf(rFov.angleDown)));
+		}
+	}
+
+	// vLevels is ordered from full detail to the coarsest; fScale is the size of the instance in scene units
+	uint32_t select(const std::vector<SLODLevel>& vLevels, const float vCenter[3], float fRadius, float fScale) const
+	{
+		if (vLevels.size() < 2 || m_fThreshold <= 0)
+			return 0;
+
+		// largest pixels per scene unit over the views, at the nearest point of the bounding sphere
+		float fPixelsPerUnit = 0;
+		for (const SView& rView : m_vViews)
+		{
+			const float* m = rView.vMatrix;
+			const float x = m[0] * vCenter[0] + m[3] * vCenter[1] + m[6] * vCenter[2] + m[9];
+			const float y = m[1] * vCenter[0] + m[4] * vCenter[1] + m[7] * vCenter[2] + m[10];
+			const float z = m[2] * vCenter[0] + m[5] * vCenter[1] + m[8] * vCenter[2] + m[11];
+			const float fDistance = (std::max)(sqrtf(x * x + y * y + z * z) - fRadius, 0.01f);
+			fPixelsPerUnit = (std::max)(fPixelsPerUnit, rView.fPixelsPerTangent / fDistance);
+		}
+
+		const float fMaxError = m_fThreshold / (fPixelsPerUnit * fScale);
+		for (size_t i = vLevels.size() - 1; i > 0; --i)
+			if (vLevels[i].fError <= fMaxError)
+				return (uint32_t)i;
+		return 0;
+	}
+
+protected:
+	struct SView
+	{
+		float	vMatrix[12];	// 3 rows of 4 columns, column major
+		float	fPixelsPerTangent;
+	};
+
+	std::vector<SView>	m_vViews;
+	float	m_fThreshold = 1.0f;
+};
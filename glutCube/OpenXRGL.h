@@ -12,9 +12,18 @@
 
 #include <GL/glew.h>
 
+#include "GLShader.h"
+#include "Handle.h"
+#include "PerfCounter.h"
+#include "ThreadPool.h"
+
 // STD Header
 #include <iostream>
+#include <algorithm>
 #include <array>
+#include <chrono>
+#include <future>
+#include <memory>
 #include <vector>
 
 class COpenXRGL
@@ -22,35 +31,208 @@ class COpenXRGL
 public:
 	using TMatrix = std::array<float, 16>;
 
+	// How to rank the swapchain formats the runtime supports
+	enum class EFormatPolicy
+	{
+		SRGB,			// sRGB-correct 8 bit color first
+		LowBandwidth,	// fewest bytes per pixel first
+		HDR				// floating point formats first
+	};
+
+	// Background composited by the runtime underneath the projection layer
+	enum class EBackground
+	{
+		None,
+		Cube,			// XR_KHR_composition_layer_cube
+		Equirect		// XR_KHR_composition_layer_equirect2
+	};
+
+	// Per-view data of the current frame
+	struct SViewInfo
+	{
+		XrFovf		xrFov;
+		XrPosef		xrPose;
+		uint32_t	uWidth;
+		uint32_t	uHeight;
+		TMatrix		matProjection;
+		TMatrix		matModelView;
+		TMatrix		matEyeView;		// relative to the head between the eyes, so only the eye offset; for fixed camera paths
+	};
+
+	struct SFormatInfo
+	{
+		int64_t		iFormat;
+		const char*	sName;
+		uint32_t	uBytesPerPixel;
+		bool		bSRGB;
+		bool		bHDR;
+		bool		bAlpha;
+	};
+
 public:
-	COpenXRGL()
+	COpenXRGL() = default;
+
+	// Start the GL independent part of init() on another thread, to overlap it with window and GL context creation.
+	// Options like setViewConfiguration() must be set before.
+	void beginInit()
 	{
-		enumerateApiLayers();
-		enumerateExtensions();
+		m_perfColdStart.begin();
+		m_futInstance = std::async(std::launch::async, [this]() {
+			return initInstance();
+		});
 	}
 
+	// Finish the initialization on the thread of the GL context; the instance is created here if beginInit() was not called
 	bool init()
 	{
+		setState(XR_SESSION_STATE_IDLE);
+		bool bInstance = false;
+		if (m_futInstance.valid())
+		{
+			m_perfWaitInstance.begin();
+			bInstance = m_futInstance.get();
+			m_perfWaitInstance.end();
+		}
+		else
+		{
+			m_perfColdStart.begin();
+			bInstance = initInstance();
+		}
+
+		m_perfSession.begin();
+		if (bInstance && initGraphics() && initSession())
+		{
+			m_perfSession.end();
+			m_perfColdStart.end();
+			std::cout << "Cold start: " << m_perfColdStart.lastMs() << " ms (instance " << m_perfInstance.lastMs() << " ms, waited "
+				<< m_perfWaitInstance.lastMs() << " ms for it; graphics and session " << m_perfSession.lastMs() << " ms)" << std::endl;
+			return true;
+		}
+		return false;
+	}
+
+	// Instance-scoped objects, kept when the session is recycled. Does not use GL, so it can run on any thread.
+	bool initInstance()
+	{
+		m_perfInstance.begin();
+		enumerateApiLayers();
+		enumerateExtensions();
 		useExtension(XR_KHR_OPENGL_ENABLE_EXTENSION_NAME);
-		if (createInstance() &&
+		m_bHasVisibilityMask = useExtension(XR_KHR_VISIBILITY_MASK_EXTENSION_NAME);
+		m_bHasCubeLayer = useExtension(XR_KHR_COMPOSITION_LAYER_CUBE_EXTENSION_NAME);
+		m_bHasEquirectLayer = useExtension(XR_KHR_COMPOSITION_LAYER_EQUIRECT2_EXTENSION_NAME);
+		if (m_xrViewConfigType == XR_VIEW_CONFIGURATION_TYPE_PRIMARY_QUAD_VARJO)
+			useExtension(XR_VARJO_QUAD_VIEWS_EXTENSION_NAME);
+		if (!m_pThreadPool)
+			m_pThreadPool = std::make_unique<CThreadPool>();
+		const bool bOK = createInstance() &&
 			getSystem() &&
-			createSession() &&
-			createReferenceSpace() &&
 			checkViewConfiguration() &&
+			queryGraphicsRequirements();
+		m_perfInstance.end();
+		return bOK;
+	}
+
+	// GL objects of the instance, on the thread of the GL context
+	bool initGraphics()
+	{
+		GLint iMajor = 0, iMinor = 0;
+		glGetIntegerv(GL_MAJOR_VERSION, &iMajor);
+		glGetIntegerv(GL_MINOR_VERSION, &iMinor);
+		if (XR_MAKE_VERSION(iMajor, iMinor, 0) < m_xrGraphicsRequirements.minApiVersionSupported)
+		{
+			std::cout << "Error: OpenGL " << iMajor << "." << iMinor << " is older than the runtime requires ("
+				<< XR_VERSION_MAJOR(m_xrGraphicsRequirements.minApiVersionSupported) << "." << XR_VERSION_MINOR(m_xrGraphicsRequirements.minApiVersionSupported) << ")" << std::endl;
+			return false;
+		}
+		return createFrameBubber();
+	}
+
+	// Session-scoped objects
+	bool initSession()
+	{
+		return createSession() &&
+			createReferenceSpace() &&
+			selectSwapchainFormat() &&
 			createSwapChain() &&
-			prepareCompositionLayer())
+			createDepthStencilBuffer() &&
+			loadVisibilityMasks() &&
+			createBackgroundLayer() &&
+			prepareCompositionLayer();
+	}
+
+	// XR_KHR_opengl_enable needs the GL context of the session current to destroy the swapchains and the session
+	void releaseSession()
+	{
+		m_vLayersPointers.clear();
+		m_vProjectionLayerViews.clear();
+		m_mBackground.xrSwapchain.reset();
+		for (auto& rVData : m_vViewDatas)
 		{
-			return createFrameBubber();
+			rVData.m_xrSwapChain.reset();
+			rVData.m_vSwapchainImages.clear();
 		}
+		m_xrSpace.reset();
+		m_xrSession.reset();
+		m_bSessionRunning = false;
+		setState(XR_SESSION_STATE_IDLE);
+	}
+
+	// Tear down and rebuild only the session, keep instance, system, extensions and GL resources
+	bool recycleSession()
+	{
+		m_perfRecycle.begin();
+		m_tpRecycleTry = std::chrono::steady_clock::now();
+		releaseSession();
+		if (initSession())
+		{
+			m_perfRecycle.end();
+			std::cout << "Session recycled in " << m_perfRecycle.lastMs() << " ms (cold start " << m_perfColdStart.lastMs() << " ms)" << std::endl;
+			m_bSessionLost = false;
+			return true;
+		}
+
+		// the system may be unavailable for a while, retry in processEvent()
+		m_bSessionLost = true;
 		return false;
 	}
 
-	void release()
+	// GL objects of the views, while the GL context is still current
+	void releaseGraphics()
 	{
 		for (auto& rVData : m_vViewDatas)
-			glDeleteFramebuffers(1, &rVData.m_glFrameBuffer);
+		{
+			rVData.m_glFrameBuffer.reset();
+			rVData.m_glDepthStencil.reset();
+			rVData.m_mMask = {};
+		}
+		m_mMaskProgram.release();
+		m_vGPUTimers.clear();
+	}
+
+	// What is left once the session and the graphics are released, no GL context needed
+	void releaseInstance()
+	{
+		reportCpuUsage();
+		m_xrInstance.reset();
+	}
+
+	void release()
+	{
+		releaseSession();
+		releaseGraphics();
+		releaseInstance();
+	}
 
-		check(xrDestroyInstance(m_xrInstance), "xrDestroyInstance");
+	// Recreate the session on XR_SESSION_STATE_EXITING too, instead of letting the application quit
+	void setRecycleOnExit(bool bRecycle)
+	{
+		m_bRecycleOnExit = bRecycle;
+	}
+
+	XrSessionState getSessionState() const
+	{
+		return m_xrState;
 	}
 
 	bool useExtension(const char* sExtName)
@@ -65,31 +247,200 @@ public:
 		return false;
 	}
 
+	// Pre-fill depth and stencil with the hidden area mesh of XR_KHR_visibility_mask, so pixels hidden by the lens are not shaded
+	void setVisibilityMask(bool bEnable)
+	{
+		m_bUseVisibilityMask = bEnable;
+	}
+
+	bool isVisibilityMaskUsed() const
+	{
+		return m_bUseVisibilityMask && m_bHasVisibilityMask;
+	}
+
+	// Static background uploaded once; vPixels are RGBA 8 bit, the 6 faces in GL order (+X, -X, +Y, -Y, +Z, -Z) for a cube.
+	// The projection layer is then blended over it by alpha, so clear to alpha 0 where the background should show.
+	// Return false if the runtime does not support the layer type.
+	bool setBackground(EBackground eType, uint32_t uWidth, uint32_t uHeight, std::vector<uint8_t> vPixels)
+	{
+		if ((eType == EBackground::Cube && !m_bHasCubeLayer) || (eType == EBackground::Equirect && !m_bHasEquirectLayer))
+			return false;
+
+		m_mBackground.eType = eType;
+		m_mBackground.uWidth = uWidth;
+		m_mBackground.uHeight = uHeight;
+		m_mBackground.vPixels = std::move(vPixels);
+
+		// kept for session recycling; applied now if the session exists. The projection layer is blended over the
+		// background by its alpha, so its swapchains are created again if their format has none.
+		if (m_xrSession)
+		{
+			if (!getFormatInfo(m_iSwapchainFormat).bAlpha && !(selectSwapchainFormat() && createSwapChain()))
+				return false;
+			return createBackgroundLayer() && prepareCompositionLayer();
+		}
+		return true;
+	}
+
+	EBackground getBackground() const
+	{
+		return m_mBackground.xrSwapchain ? m_mBackground.eType : EBackground::None;
+	}
+
+	// Preferred view configuration, fall back to what the runtime supports if it is not available
+	void setViewConfiguration(XrViewConfigurationType xrViewConfigType)
+	{
+		m_xrViewConfigType = xrViewConfigType;
+	}
+
+	XrViewConfigurationType getViewConfiguration() const
+	{
+		return m_xrViewConfigType;
+	}
+
+	uint32_t getViewCount() const
+	{
+		return (uint32_t)m_vViews.size();
+	}
+
+	// Workers of the per-view CPU work, idle outside of func_prepare; shared so other per-frame work does not
+	// start its own threads next to them
+	CThreadPool& getThreadPool()
+	{
+		return *m_pThreadPool;
+	}
+
+	// Views located for the current frame, valid inside draw()
+	const std::vector<SViewInfo>& getViewInfos() const
+	{
+		return m_vViewInfos;
+	}
+
+	// CPU time between xrWaitFrame() and xrEndFrame()
+	CPerfCounter& getFrameCounter()
+	{
+		return m_perfFrame;
+	}
+
+	// Measure the GPU time of each view, from the clear and the hidden area mask to the end of func_draw
+	void setGPUTiming(bool bEnable)
+	{
+		m_bGPUTiming = bEnable;
+	}
+
+	// GPU time of all views of the last rendered frame; blocks until the results are available
+	double getFrameGPUMs() const
+	{
+		double dMs = 0;
+		for (const auto& rTimer : m_vGPUTimers)
+			dMs += rTimer.resultMs();
+		return dMs;
+	}
+
+	void setSwapchainFormatPolicy(EFormatPolicy ePolicy)
+	{
+		m_eFormatPolicy = ePolicy;
+	}
+
+	// Supported swapchain formats, ranked by the current policy
+	const std::vector<int64_t>& getSwapchainFormats() const
+	{
+		return m_vSwapchainFormats;
+	}
+
+	int64_t getSwapchainFormat() const
+	{
+		return m_iSwapchainFormat;
+	}
+
+	uint32_t getSwapchainWidth(uint32_t uViewIdx = 0) const
+	{
+		return uViewIdx < m_vViews.size() ? m_vViews[uViewIdx].recommendedImageRectWidth : 0;
+	}
+
+	uint32_t getSwapchainHeight(uint32_t uViewIdx = 0) const
+	{
+		return uViewIdx < m_vViews.size() ? m_vViews[uViewIdx].recommendedImageRectHeight : 0;
+	}
+
+	static SFormatInfo getFormatInfo(int64_t iFormat)
+	{
+		static const SFormatInfo aFormats[] = {
+			{ GL_RGB565,			"GL_RGB565",			2, false, false, false },
+			{ GL_RGBA8,				"GL_RGBA8",				4, false, false, true },
+			{ GL_SRGB8,				"GL_SRGB8",				3, true,  false, false },
+			{ GL_SRGB8_ALPHA8,		"GL_SRGB8_ALPHA8",		4, true,  false, true },
+			{ GL_RGB10_A2,			"GL_RGB10_A2",			4, false, false, true },
+			{ GL_R11F_G11F_B10F,	"GL_R11F_G11F_B10F",	4, false, true,  false },
+			{ GL_RGB16F,			"GL_RGB16F",			6, false, true,  false },
+			{ GL_RGBA16F,			"GL_RGBA16F",			8, false, true,  true },
+			{ GL_RGBA16,			"GL_RGBA16",			8, false, false, true },
+			{ GL_RGBA32F,			"GL_RGBA32F",			16, false, true, true },
+			{ GL_DEPTH_COMPONENT16,	"GL_DEPTH_COMPONENT16",	2, false, false, false },
+			{ GL_DEPTH_COMPONENT24,	"GL_DEPTH_COMPONENT24",	3, false, false, false },
+			{ GL_DEPTH_COMPONENT32F,"GL_DEPTH_COMPONENT32F",4, false, false, false },
+			{ GL_DEPTH24_STENCIL8,	"GL_DEPTH24_STENCIL8",	4, false, false, false },
+			{ GL_DEPTH32F_STENCIL8,	"GL_DEPTH32F_STENCIL8",	8, false, false, false }
+		};
+
+		for (const auto& rInfo : aFormats)
+			if (rInfo.iFormat == iFormat)
+				return rInfo;
+		return { iFormat, "Unknown", 0, false, false, false };
+	}
+
+	static bool isColorFormat(int64_t iFormat)
+	{
+		switch (iFormat)
+		{
+		case GL_DEPTH_COMPONENT16:
+		case GL_DEPTH_COMPONENT24:
+		case GL_DEPTH_COMPONENT32F:
+		case GL_DEPTH24_STENCIL8:
+		case GL_DEPTH32F_STENCIL8:
+			return false;
+		}
+		return getFormatInfo(iFormat).uBytesPerPixel > 0;
+	}
+
 	bool beginSession()
 	{
-		XrSessionBeginInfo sbi{ XR_TYPE_SESSION_BEGIN_INFO, nullptr, XR_VIEW_CONFIGURATION_TYPE_PRIMARY_STEREO };
-		return check(xrBeginSession(m_xrSession, &sbi), "xrBeginSession");
+		XrSessionBeginInfo sbi{ XR_TYPE_SESSION_BEGIN_INFO, nullptr, m_xrViewConfigType };
+		m_bSessionRunning = check(xrBeginSession(m_xrSession, &sbi), "xrBeginSession");
+		return m_bSessionRunning;
 	}
 
 	bool endSession()
 	{
+		m_bSessionRunning = false;
 		return check(xrEndSession(m_xrSession), "xrEndSession");
 	}
 
-	void processEvent()
+	// Return true if any event was processed
+	bool processEvent()
 	{
+		// retry a failed recycle about once a second
+		if (m_bSessionLost && std::chrono::steady_clock::now() - m_tpRecycleTry > std::chrono::seconds(1))
+			recycleSession();
+
+		bool bProcessed = false;
 		while (true) {
 			XrEventDataBuffer eventBuffer{ XR_TYPE_EVENT_DATA_BUFFER };
 			auto pollResult = xrPollEvent(m_xrInstance, &eventBuffer);
 			//check(pollResult, "xrPollEvent");
-			if (pollResult == XR_EVENT_UNAVAILABLE) {
+			if (pollResult != XR_SUCCESS) {
 				break;
 			}
+			bProcessed = true;
 
 			switch (eventBuffer.type) {
 			case XR_TYPE_EVENT_DATA_SESSION_STATE_CHANGED:
 			{
-				m_xrState = reinterpret_cast<XrEventDataSessionStateChanged&>(eventBuffer).state;
+				const auto& rEvent = reinterpret_cast<XrEventDataSessionStateChanged&>(eventBuffer);
+				if (rEvent.session != m_xrSession.get())
+					break;	// queued for a session already recycled
+
+				setState(rEvent.state);
 				switch (m_xrState) {
 				case XR_SESSION_STATE_READY:
 					beginSession();
@@ -98,19 +449,112 @@ public:
 				case XR_SESSION_STATE_STOPPING:
 					endSession();
 					break;
+
+				case XR_SESSION_STATE_LOSS_PENDING:
+					recycleSession();
+					break;
+
+				case XR_SESSION_STATE_EXITING:
+					if (m_bRecycleOnExit)
+					{
+						recycleSession();
+					}
+					else
+					{
+						releaseSession();
+						setState(XR_SESSION_STATE_EXITING);
+					}
+					break;
 				}
 			}
 			break;
 
+			case XR_TYPE_EVENT_DATA_VISIBILITY_MASK_CHANGED_KHR:
+			{
+				const auto& rEvent = reinterpret_cast<XrEventDataVisibilityMaskChangedKHR&>(eventBuffer);
+				if (rEvent.session == m_xrSession.get() && rEvent.viewConfigurationType == m_xrViewConfigType)
+					loadVisibilityMask(rEvent.viewIndex);
+			}
+			break;
+
 			default:
 				break;
 			}
 		}
+		return bProcessed;
+	}
+
+	// There is no blocking event wait in OpenXR, so poll with a coarse sleep until an event arrives or time runs out
+	bool waitEvent(uint32_t uTimeoutMs, uint32_t uPollIntervalMs = 10)
+	{
+		const auto tpEnd = std::chrono::steady_clock::now() + std::chrono::milliseconds(uTimeoutMs);
+		while (true)
+		{
+			if (processEvent())
+				return true;
+			if (std::chrono::steady_clock::now() >= tpEnd)
+				return false;
+			Sleep(uPollIntervalMs);
+		}
+	}
+
+	// Between xrBeginSession() and xrEndSession(), when xrWaitFrame() paces the frame loop
+	bool isSessionRunning() const
+	{
+		return m_bSessionRunning;
+	}
+
+	static const char* toString(XrSessionState xrState)
+	{
+		switch (xrState)
+		{
+		case XR_SESSION_STATE_IDLE:
+			return "IDLE";
+		case XR_SESSION_STATE_READY:
+			return "READY";
+		case XR_SESSION_STATE_SYNCHRONIZED:
+			return "SYNCHRONIZED";
+		case XR_SESSION_STATE_VISIBLE:
+			return "VISIBLE";
+		case XR_SESSION_STATE_FOCUSED:
+			return "FOCUSED";
+		case XR_SESSION_STATE_STOPPING:
+			return "STOPPING";
+		case XR_SESSION_STATE_LOSS_PENDING:
+			return "LOSS_PENDING";
+		case XR_SESSION_STATE_EXITING:
+			return "EXITING";
+		}
+		return "UNKNOWN";
+	}
+
+	// Process CPU usage spent in each session state so far
+	void reportCpuUsage()
+	{
+		std::cout << "CPU usage per session state (100% = one core):\n";
+		for (const auto& rPair : m_cpuUsage.usage())
+			std::cout << " - " << toString((XrSessionState)rPair.first) << ": " << rPair.second.percent() << "% over " << rPair.second.dWallMs / 1000 << " s\n";
+		std::cout << std::endl;
 	}
 
 	template<typename FUNC_DRAW>
-	void draw(FUNC_DRAW func_draw)
+	bool draw(FUNC_DRAW func_draw)
+	{
+		return draw([](uint32_t, const SViewInfo&) {}, [&func_draw](uint32_t, const SViewInfo& rView) {
+			func_draw(rView.matProjection, rView.matModelView);
+		});
+	}
+
+	// func_prepare(uViewIdx, rView) runs in parallel for all views, for CPU work like culling;
+	// func_draw(uViewIdx, rView) is then called for each view in order on the GL thread, with the view cleared and
+	// the hidden area already masked out by the stencil test: while the mask is used, func_draw runs with
+	// GL_STENCIL_TEST enabled, glStencilFunc(GL_EQUAL, 0, 0xFF) and stencil 1 in the hidden area, and the stencil
+	// test is disabled again afterwards. Callers that need the stencil buffer turn the mask off with setVisibilityMask().
+	// Return true if the views were rendered and the mirror window was updated.
+	template<typename FUNC_PREPARE, typename FUNC_DRAW>
+	bool draw(FUNC_PREPARE func_prepare, FUNC_DRAW func_draw)
 	{
+		bool bRendered = false;
 		switch (m_xrState) {
 		case XR_SESSION_STATE_READY:
 		case XR_SESSION_STATE_FOCUSED:
@@ -121,8 +565,7 @@ public:
 			XrFrameWaitInfo frameWaitInfo{ XR_TYPE_FRAME_WAIT_INFO, nullptr };
 			if (XR_UNQUALIFIED_SUCCESS(xrWaitFrame(m_xrSession, &frameWaitInfo, &frameState)))
 			{
-				uint32_t	uWidth = m_vViews[0].maxImageRectWidth,
-					uHeight = m_vViews[0].maxImageRectHeight;
+				m_perfFrame.begin();
 
 				XrFrameBeginInfo frameBeginInfo{ XR_TYPE_FRAME_BEGIN_INFO };
 				check(xrBeginFrame(m_xrSession, &frameBeginInfo), "xrBeginFrame");
@@ -131,7 +574,7 @@ public:
 				if (frameState.shouldRender)
 				{
 					XrViewState vs{ XR_TYPE_VIEW_STATE };
-					XrViewLocateInfo vi{ XR_TYPE_VIEW_LOCATE_INFO, nullptr, XR_VIEW_CONFIGURATION_TYPE_PRIMARY_STEREO, frameState.predictedDisplayTime, m_xrSpace };
+					XrViewLocateInfo vi{ XR_TYPE_VIEW_LOCATE_INFO, nullptr, m_xrViewConfigType, frameState.predictedDisplayTime, m_xrSpace };
 
 					uint32_t eyeViewStateCount = 0;
 					std::vector<XrView> eyeViewStates;
@@ -139,12 +582,53 @@ public:
 					eyeViewStates.resize(eyeViewStateCount, { XR_TYPE_VIEW });
 					check(xrLocateViews(m_xrSession, &vi, &vs, eyeViewStateCount, &eyeViewStateCount, eyeViewStates.data()), "xrLocateViews-2");
 
-					for (int i = 0; i < eyeViewStates.size(); ++i)
+					const uint32_t uViewNum = (std::min)(eyeViewStateCount, (uint32_t)m_vViewDatas.size());
+					m_vViewInfos.resize(uViewNum);
+					if (m_bGPUTiming && m_vGPUTimers.size() != uViewNum)
+						m_vGPUTimers.resize(uViewNum);
+
+					// Head pose between the views: mean position, orientation of the first view blended with the others
+					XrPosef xrHead = eyeViewStates[0].pose;
+					if (uViewNum > 1)
 					{
+						XrVector3f vPos{ 0, 0, 0 };
+						XrQuaternionf qSum{ 0, 0, 0, 0 };
+						const XrQuaternionf& q0 = eyeViewStates[0].pose.orientation;
+						for (uint32_t i = 0; i < uViewNum; ++i)
+						{
+							const XrPosef& rPose = eyeViewStates[i].pose;
+							vPos = { vPos.x + rPose.position.x, vPos.y + rPose.position.y, vPos.z + rPose.position.z };
+							const float fSign = (q0.x * rPose.orientation.x + q0.y * rPose.orientation.y + q0.z * rPose.orientation.z + q0.w * rPose.orientation.w) < 0 ? -1.0f : 1.0f;
+							qSum = { qSum.x + fSign * rPose.orientation.x, qSum.y + fSign * rPose.orientation.y, qSum.z + fSign * rPose.orientation.z, qSum.w + fSign * rPose.orientation.w };
+						}
+						const float fLength = sqrtf(qSum.x * qSum.x + qSum.y * qSum.y + qSum.z * qSum.z + qSum.w * qSum.w);
+						xrHead.orientation = { qSum.x / fLength, qSum.y / fLength, qSum.z / fLength, qSum.w / fLength };
+						xrHead.position = { vPos.x / uViewNum, vPos.y / uViewNum, vPos.z / uViewNum };
+					}
+
+					// Per-view CPU work, in parallel
+					m_pThreadPool->parallelFor(uViewNum, [&](size_t i) {
 						const XrView& viewStates = eyeViewStates[i];
+						SViewInfo& rView = m_vViewInfos[i];
+						rView.xrFov = viewStates.fov;
+						rView.xrPose = viewStates.pose;
+						rView.uWidth = m_vViews[i].recommendedImageRectWidth;
+						rView.uHeight = m_vViews[i].recommendedImageRectHeight;
+						rView.matProjection = createProjectionMatrix(viewStates.fov, 0.01f, 1000);
+						rView.matModelView = createModelViewMatrix(viewStates.pose);
+						rView.matEyeView = createModelViewMatrix(relativePose(xrHead, viewStates.pose));
+
 						m_vProjectionLayerViews[i].fov = viewStates.fov;
 						m_vProjectionLayerViews[i].pose = viewStates.pose;
 
+						func_prepare((uint32_t)i, (const SViewInfo&)rView);
+					});
+
+					// GL submission, in order
+					for (uint32_t i = 0; i < uViewNum; ++i)
+					{
+						const SViewInfo& rView = m_vViewInfos[i];
+
 						uint32_t swapchainIndex;
 
 						XrSwapchainImageAcquireInfo ai{ XR_TYPE_SWAPCHAIN_IMAGE_ACQUIRE_INFO, nullptr };
@@ -154,15 +638,34 @@ public:
 						check(xrWaitSwapchainImage(m_vViewDatas[i].m_xrSwapChain, &wi), "xrWaitSwapchainImage");
 
 						{
-							glViewport(0, 0, uWidth, uHeight);
-							glScissor(0, 0, uWidth, uHeight);
+							glViewport(0, 0, rView.uWidth, rView.uHeight);
+							glScissor(0, 0, rView.uWidth, rView.uHeight);
 
 							glBindFramebuffer(GL_FRAMEBUFFER, m_vViewDatas[i].m_glFrameBuffer);
-							glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, m_vViewDatas[i].m_vSwapchainImages[swapchainIndex].image, 0);
-
-							auto proj = createProjectionMatrix(viewStates.fov, 0.01, 1000);
-							auto view = createModelViewMatrix(viewStates.pose);
-							func_draw(proj, view);
+							glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, m_uSampleCount > 1 ? GL_TEXTURE_2D_MULTISAMPLE : GL_TEXTURE_2D, m_vViewDatas[i].m_vSwapchainImages[swapchainIndex].image, 0);
+							if (getFormatInfo(m_iSwapchainFormat).bSRGB)
+								glEnable(GL_FRAMEBUFFER_SRGB);
+							else
+								glDisable(GL_FRAMEBUFFER_SRGB);
+
+							if (m_bGPUTiming)
+								m_vGPUTimers[i].begin();
+
+							glClearStencil(0);
+							glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
+							const bool bMasked = isVisibilityMaskUsed() && m_vViewDatas[i].m_mMask.iIndexNum > 0;
+							if (bMasked)
+								drawVisibilityMask(i, rView);
+
+							func_draw(i, rView);
+
+							if (bMasked)
+							{
+								glStencilFunc(GL_ALWAYS, 0, 0xFF);
+								glDisable(GL_STENCIL_TEST);
+							}
+							if (m_bGPUTiming)
+								m_vGPUTimers[i].end();
 
 							glBindFramebuffer(GL_FRAMEBUFFER, 0);
 							glFinish();
@@ -172,18 +675,21 @@ public:
 						check(xrReleaseSwapchainImage(m_vViewDatas[i].m_xrSwapChain, &ri), "xrReleaseSwapchainImage");
 					}
 
+					const GLint	iWidth = (GLint)m_vViews[0].recommendedImageRectWidth,
+						iHeight = (GLint)m_vViews[0].recommendedImageRectHeight;
 					glBlitNamedFramebuffer(m_vViewDatas[0].m_glFrameBuffer, // backbuffer
 						(GLuint)0,							// drawFramebuffer
 						(GLint)0,							// srcX0
 						(GLint)0,							// srcY0
-						(GLint)uWidth,						// srcX1
-						(GLint)uHeight,						// srcY1
+						iWidth,								// srcX1
+						iHeight,							// srcY1
 						(GLint)0,							// dstX0
 						(GLint)0,							// dstY0
-						(GLint)uWidth,						// dstX1
-						(GLint)uHeight,						// dstY1
+						iWidth,								// dstX1
+						iHeight,							// dstY1
 						(GLbitfield)GL_COLOR_BUFFER_BIT,	// mask
 						(GLenum)GL_LINEAR);					// filter
+					bRendered = true;
 				}
 
 				// End frame
@@ -193,6 +699,7 @@ public:
 					frameEndInfo.layers = m_vLayersPointers.data();
 				}
 
+				m_perfFrame.end();
 				check(xrEndFrame(m_xrSession, &frameEndInfo), "xrEndFrame");
 			}
 			break;
@@ -201,17 +708,46 @@ public:
 		default:
 			break;
 		}
+		return bRendered;
 	}
 
 protected:
+	struct SBackground
+	{
+		EBackground		eType = EBackground::None;
+		uint32_t		uWidth = 0;
+		uint32_t		uHeight = 0;
+		std::vector<uint8_t>	vPixels;
+		int64_t			iFormat = GL_SRGB8_ALPHA8;
+		CXrSwapchain	xrSwapchain;
+		XrCompositionLayerCubeKHR		xrCubeLayer{ XR_TYPE_COMPOSITION_LAYER_CUBE_KHR };
+		XrCompositionLayerEquirect2KHR	xrEquirectLayer{ XR_TYPE_COMPOSITION_LAYER_EQUIRECT2_KHR };
+	};
+
 	struct SViewData
 	{
-		XrSwapchain	m_xrSwapChain;
-		GLuint		m_glFrameBuffer = 0;
+		CXrSwapchain	m_xrSwapChain;
+		CGLFramebuffer	m_glFrameBuffer;
+		CGLRenderbuffer	m_glDepthStencil;
 		std::vector<XrSwapchainImageOpenGLKHR>	m_vSwapchainImages;
+
+		// hidden area mesh, in tangent space at z = -1
+		struct SMask
+		{
+			CGLBuffer		glVertexBuffer;
+			CGLBuffer		glIndexBuffer;
+			CGLVertexArray	glVAO;
+			GLsizei			iIndexNum = 0;
+		} m_mMask;
 	};
 
 protected:
+	void setState(XrSessionState xrState)
+	{
+		m_xrState = xrState;
+		m_cpuUsage.enter(xrState);
+	}
+
 	bool check(const XrResult& rs, const std::string& sExtMsg)
 	{
 		if (rs == XR_SUCCESS)
@@ -257,7 +793,7 @@ protected:
 		infoCreate.enabledExtensionCount = (uint32_t)m_vRequiredExtensions.size();
 		infoCreate.enabledExtensionNames = m_vRequiredExtensions.data();
 
-		return check(xrCreateInstance(&infoCreate, &m_xrInstance), "xrCreateInstance");
+		return check(xrCreateInstance(&infoCreate, m_xrInstance.put()), "xrCreateInstance");
 	}
 
 	bool getSystem()
@@ -266,58 +802,134 @@ protected:
 		return check(xrGetSystem(m_xrInstance, &infoSysId, &m_xrSystem), "xrGetSystem");
 	}
 
-	bool createSession()
+	// Graphics requirements, must be queried before xrCreateSession()
+	bool queryGraphicsRequirements()
 	{
-		// Graphics requirements
-		XrGraphicsRequirementsOpenGLKHR reqOpenGL{ XR_TYPE_GRAPHICS_REQUIREMENTS_OPENGL_KHR };
-
 		// Magic code block....
 		// link error if call xrGetOpenGLGraphicsRequirementsKHR() directlly
 		PFN_xrGetOpenGLGraphicsRequirementsKHR func;
 		if (check(xrGetInstanceProcAddr(m_xrInstance, "xrGetOpenGLGraphicsRequirementsKHR", (PFN_xrVoidFunction*)&func), "xrGetInstanceProcAddr"))
-		{
-			if (check(func(m_xrInstance, m_xrSystem, &reqOpenGL), "PFN_xrGetOpenGLGraphicsRequirementsKHR"))
-			{
-				XrGraphicsBindingOpenGLWin32KHR gbOpenGL{ XR_TYPE_GRAPHICS_BINDING_OPENGL_WIN32_KHR , nullptr, wglGetCurrentDC(), wglGetCurrentContext() };
-				XrSessionCreateInfo infoSession{ XR_TYPE_SESSION_CREATE_INFO, &gbOpenGL, 0, m_xrSystem };
-				return check(xrCreateSession(m_xrInstance, &infoSession, &m_xrSession), "xrCreateSession");
-			}
-		}
+			return check(func(m_xrInstance, m_xrSystem, &m_xrGraphicsRequirements), "PFN_xrGetOpenGLGraphicsRequirementsKHR");
 		return false;
 	}
 
+	bool createSession()
+	{
+		XrGraphicsBindingOpenGLWin32KHR gbOpenGL{ XR_TYPE_GRAPHICS_BINDING_OPENGL_WIN32_KHR , nullptr, wglGetCurrentDC(), wglGetCurrentContext() };
+		XrSessionCreateInfo infoSession{ XR_TYPE_SESSION_CREATE_INFO, &gbOpenGL, 0, m_xrSystem };
+		return check(xrCreateSession(m_xrInstance, &infoSession, m_xrSession.put()), "xrCreateSession");
+	}
+
 	bool checkViewConfiguration()
 	{
+		// use the preferred view configuration if the runtime has it, otherwise its first one
+		uint32_t uViewConfNum = 0;
+		if (check(xrEnumerateViewConfigurations(m_xrInstance, m_xrSystem, 0, &uViewConfNum, nullptr), "xrEnumerateViewConfigurations-1") && uViewConfNum > 0)
+		{
+			std::vector<XrViewConfigurationType> vViewConf(uViewConfNum);
+			if (check(xrEnumerateViewConfigurations(m_xrInstance, m_xrSystem, uViewConfNum, &uViewConfNum, vViewConf.data()), "xrEnumerateViewConfigurations-2") &&
+				std::find(vViewConf.begin(), vViewConf.end(), m_xrViewConfigType) == vViewConf.end())
+			{
+				std::cout << "View configuration " << m_xrViewConfigType << " is not supported, use " << vViewConf[0] << std::endl;
+				m_xrViewConfigType = vViewConf[0];
+			}
+		}
+
 		uint32_t uViewsNum = 0;
-		if (check(xrEnumerateViewConfigurationViews(m_xrInstance, m_xrSystem, XR_VIEW_CONFIGURATION_TYPE_PRIMARY_STEREO, 0, &uViewsNum, nullptr), "xrEnumerateViewConfigurationViews-1") && uViewsNum > 0)
+		if (check(xrEnumerateViewConfigurationViews(m_xrInstance, m_xrSystem, m_xrViewConfigType, 0, &uViewsNum, nullptr), "xrEnumerateViewConfigurationViews-1") && uViewsNum > 0)
 		{
 			m_vViews.resize(uViewsNum, { XR_TYPE_VIEW_CONFIGURATION_VIEW });
 			m_vViewDatas.resize(uViewsNum);
-			return check(xrEnumerateViewConfigurationViews(m_xrInstance, m_xrSystem, XR_VIEW_CONFIGURATION_TYPE_PRIMARY_STEREO, uViewsNum, &uViewsNum, m_vViews.data()), "xrEnumerateViewConfigurationViews-2");
+			m_vViewInfos.resize(uViewsNum);
+			return check(xrEnumerateViewConfigurationViews(m_xrInstance, m_xrSystem, m_xrViewConfigType, uViewsNum, &uViewsNum, m_vViews.data()), "xrEnumerateViewConfigurationViews-2");
 		}
 
 		return false;
 	}
 
+	bool selectSwapchainFormat()
+	{
+		uint32_t uFormatNum = 0;
+		if (!check(xrEnumerateSwapchainFormats(m_xrSession, 0, &uFormatNum, nullptr), "xrEnumerateSwapchainFormats-1") || uFormatNum == 0)
+			return false;
+
+		std::vector<int64_t> vFormats(uFormatNum);
+		if (!check(xrEnumerateSwapchainFormats(m_xrSession, uFormatNum, &uFormatNum, vFormats.data()), "xrEnumerateSwapchainFormats-2"))
+			return false;
+
+		// only color formats we know how to render into; keep runtime preference order for ties
+		m_vSwapchainFormats.clear();
+		for (const auto& iFormat : vFormats)
+			if (isColorFormat(iFormat))
+				m_vSwapchainFormats.push_back(iFormat);
+
+		if (m_vSwapchainFormats.empty())
+		{
+			std::cout << "Error: runtime supports no known color swapchain format" << std::endl;
+			return false;
+		}
+
+		const EFormatPolicy ePolicy = m_eFormatPolicy;
+		std::stable_sort(m_vSwapchainFormats.begin(), m_vSwapchainFormats.end(), [ePolicy](int64_t iA, int64_t iB) {
+			const SFormatInfo a = getFormatInfo(iA), b = getFormatInfo(iB);
+			switch (ePolicy)
+			{
+			case EFormatPolicy::SRGB:
+				if (a.bSRGB != b.bSRGB)
+					return a.bSRGB;
+				return a.uBytesPerPixel < b.uBytesPerPixel;
+
+			case EFormatPolicy::LowBandwidth:
+				if (a.uBytesPerPixel != b.uBytesPerPixel)
+					return a.uBytesPerPixel < b.uBytesPerPixel;
+				return a.bSRGB && !b.bSRGB;
+
+			case EFormatPolicy::HDR:
+				if (a.bHDR != b.bHDR)
+					return a.bHDR;
+				return a.uBytesPerPixel < b.uBytesPerPixel;
+			}
+			return false;
+		});
+		// the projection layer needs alpha to show a background layer below it
+		if (m_mBackground.eType != EBackground::None)
+		{
+			std::stable_partition(m_vSwapchainFormats.begin(), m_vSwapchainFormats.end(), [](int64_t iFormat) {
+				return getFormatInfo(iFormat).bAlpha;
+			});
+			if (!getFormatInfo(m_vSwapchainFormats[0]).bAlpha)
+				std::cout << "Warning: no swapchain format with alpha, the background layer will be covered" << std::endl;
+		}
+		m_iSwapchainFormat = m_vSwapchainFormats[0];
+
+		// MSAA only when the runtime asks for it
+		m_uSampleCount = (std::max)(1u, m_vViews[0].recommendedSwapchainSampleCount);
+
+		std::cout << "Swapchain format: " << getFormatInfo(m_iSwapchainFormat).sName << " with " << m_uSampleCount << " sample(s)" << std::endl;
+		return true;
+	}
+
 	bool createSwapChain()
 	{
 		XrSwapchainCreateInfo infoSwapchain;
 		infoSwapchain.type = XR_TYPE_SWAPCHAIN_CREATE_INFO;
 		infoSwapchain.next = nullptr;
 		infoSwapchain.createFlags = 0;
-		infoSwapchain.usageFlags = XR_SWAPCHAIN_USAGE_TRANSFER_DST_BIT;
-		infoSwapchain.format = (int64_t)GL_SRGB8_ALPHA8;
-		infoSwapchain.sampleCount = 1;
-		infoSwapchain.width = m_vViews[0].recommendedImageRectWidth;
-		infoSwapchain.height = m_vViews[0].recommendedImageRectHeight;
+		// rendered through a FBO, and read back by the mirror window blit
+		infoSwapchain.usageFlags = XR_SWAPCHAIN_USAGE_COLOR_ATTACHMENT_BIT | XR_SWAPCHAIN_USAGE_TRANSFER_SRC_BIT;
+		infoSwapchain.format = m_iSwapchainFormat;
+		infoSwapchain.sampleCount = m_uSampleCount;
 		infoSwapchain.faceCount = 1;
 		infoSwapchain.arraySize = 1;
 		infoSwapchain.mipCount = 1;
 
 		bool bOK = true;
-		for (auto& rVData : m_vViewDatas)
+		for (size_t i = 0; i < m_vViewDatas.size(); ++i)
 		{
-			if (check(xrCreateSwapchain(m_xrSession, &infoSwapchain, &rVData.m_xrSwapChain), "xrCreateSwapchain"))
+			auto& rVData = m_vViewDatas[i];
+			infoSwapchain.width = m_vViews[i].recommendedImageRectWidth;
+			infoSwapchain.height = m_vViews[i].recommendedImageRectHeight;
+			if (check(xrCreateSwapchain(m_xrSession, &infoSwapchain, rVData.m_xrSwapChain.put()), "xrCreateSwapchain"))
 			{
 				uint32_t uSwapchainNum = 0;
 				if (check(xrEnumerateSwapchainImages(rVData.m_xrSwapChain, uSwapchainNum, &uSwapchainNum, nullptr), "xrEnumerateSwapchainImages-1") && uSwapchainNum > 0)
@@ -345,28 +957,230 @@ protected:
 		return bOK;
 	}
 
+	bool createDepthStencilBuffer()
+	{
+		for (size_t i = 0; i < m_vViewDatas.size(); ++i)
+		{
+			auto& rVData = m_vViewDatas[i];
+			glCreateRenderbuffers(1, rVData.m_glDepthStencil.put());
+			if (m_uSampleCount > 1)
+				glNamedRenderbufferStorageMultisample(rVData.m_glDepthStencil, m_uSampleCount, GL_DEPTH24_STENCIL8, m_vViews[i].recommendedImageRectWidth, m_vViews[i].recommendedImageRectHeight);
+			else
+				glNamedRenderbufferStorage(rVData.m_glDepthStencil, GL_DEPTH24_STENCIL8, m_vViews[i].recommendedImageRectWidth, m_vViews[i].recommendedImageRectHeight);
+			glNamedFramebufferRenderbuffer(rVData.m_glFrameBuffer, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, rVData.m_glDepthStencil);
+		}
+		return true;
+	}
+
+	// A view without a mask is drawn unmasked, so this never fails the session
+	bool loadVisibilityMasks()
+	{
+		for (uint32_t i = 0; i < m_vViewDatas.size(); ++i)
+			loadVisibilityMask(i);
+		return true;
+	}
+
+	void loadVisibilityMask(uint32_t uViewIdx)
+	{
+		if (!m_bHasVisibilityMask || uViewIdx >= m_vViewDatas.size())
+			return;
+
+		auto& rMask = m_vViewDatas[uViewIdx].m_mMask;
+		rMask = {};
+
+		PFN_xrGetVisibilityMaskKHR func;
+		if (!check(xrGetInstanceProcAddr(m_xrInstance, "xrGetVisibilityMaskKHR", (PFN_xrVoidFunction*)&func), "xrGetInstanceProcAddr"))
+			return;
+
+		XrVisibilityMaskKHR xrMask{ XR_TYPE_VISIBILITY_MASK_KHR };
+		if (!check(func(m_xrSession, m_xrViewConfigType, uViewIdx, XR_VISIBILITY_MASK_TYPE_HIDDEN_TRIANGLE_MESH_KHR, &xrMask), "xrGetVisibilityMaskKHR-1") ||
+			xrMask.vertexCountOutput == 0 || xrMask.indexCountOutput == 0)
+			return;
+
+		std::vector<XrVector2f> vVertices(xrMask.vertexCountOutput);
+		std::vector<uint32_t> vIndices(xrMask.indexCountOutput);
+		xrMask.vertexCapacityInput = (uint32_t)vVertices.size();
+		xrMask.vertices = vVertices.data();
+		xrMask.indexCapacityInput = (uint32_t)vIndices.size();
+		xrMask.indices = vIndices.data();
+		if (!check(func(m_xrSession, m_xrViewConfigType, uViewIdx, XR_VISIBILITY_MASK_TYPE_HIDDEN_TRIANGLE_MESH_KHR, &xrMask), "xrGetVisibilityMaskKHR-2"))
+			return;
+
+		glCreateBuffers(1, rMask.glVertexBuffer.put());
+		glNamedBufferStorage(rMask.glVertexBuffer, xrMask.vertexCountOutput * sizeof(XrVector2f), vVertices.data(), 0);
+		glCreateBuffers(1, rMask.glIndexBuffer.put());
+		glNamedBufferStorage(rMask.glIndexBuffer, xrMask.indexCountOutput * sizeof(uint32_t), vIndices.data(), 0);
+
+		glCreateVertexArrays(1, rMask.glVAO.put());
+		glVertexArrayVertexBuffer(rMask.glVAO, 0, rMask.glVertexBuffer, 0, sizeof(XrVector2f));
+		glVertexArrayElementBuffer(rMask.glVAO, rMask.glIndexBuffer);
+		glEnableVertexArrayAttrib(rMask.glVAO, 0);
+		glVertexArrayAttribFormat(rMask.glVAO, 0, 2, GL_FLOAT, GL_FALSE, 0);
+		glVertexArrayAttribBinding(rMask.glVAO, 0, 0);
+		rMask.iIndexNum = (GLsizei)xrMask.indexCountOutput;
+	}
+
+	// Write stencil 1 and nearest depth in the hidden area, then leave the stencil test rejecting it
+	void drawVisibilityMask(uint32_t uViewIdx, const SViewInfo& rView)
+	{
+		GLboolean bDepthTest = glIsEnabled(GL_DEPTH_TEST), bCullFace = glIsEnabled(GL_CULL_FACE);
+		GLint iDepthFunc = GL_LESS;
+		glGetIntegerv(GL_DEPTH_FUNC, &iDepthFunc);
+		GLboolean aColorMask[4] = { GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE };
+		glGetBooleanv(GL_COLOR_WRITEMASK, aColorMask);
+		glEnable(GL_DEPTH_TEST);
+		glDepthFunc(GL_ALWAYS);
+		glDisable(GL_CULL_FACE);
+		glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+		glEnable(GL_STENCIL_TEST);
+		glStencilFunc(GL_ALWAYS, 1, 0xFF);
+		glStencilOp(GL_KEEP, GL_KEEP, GL_REPLACE);
+
+		m_mMaskProgram.use();
+		glProgramUniformMatrix4fv(m_mMaskProgram.id(), 0, 1, GL_FALSE, rView.matProjection.data());
+		glBindVertexArray(m_vViewDatas[uViewIdx].m_mMask.glVAO);
+		glDrawElements(GL_TRIANGLES, m_vViewDatas[uViewIdx].m_mMask.iIndexNum, GL_UNSIGNED_INT, nullptr);
+
+		glColorMask(aColorMask[0], aColorMask[1], aColorMask[2], aColorMask[3]);
+		glDepthFunc(iDepthFunc);
+		if (!bDepthTest)
+			glDisable(GL_DEPTH_TEST);
+		if (bCullFace)
+			glEnable(GL_CULL_FACE);
+		glStencilFunc(GL_EQUAL, 0, 0xFF);
+		glStencilOp(GL_KEEP, GL_KEEP, GL_KEEP);
+	}
+
 	bool createReferenceSpace()
 	{
 		XrReferenceSpaceCreateInfo infoRefSpace{ XR_TYPE_REFERENCE_SPACE_CREATE_INFO, nullptr, XR_REFERENCE_SPACE_TYPE_LOCAL };
 		infoRefSpace.poseInReferenceSpace.orientation = { 0,0,0,-1 };
 		infoRefSpace.poseInReferenceSpace.position = { 0,0,0 };
-		return check(xrCreateReferenceSpace(m_xrSession, &infoRefSpace, &m_xrSpace), "xrCreateReferenceSpace");
+		return check(xrCreateReferenceSpace(m_xrSession, &infoRefSpace, m_xrSpace.put()), "xrCreateReferenceSpace");
+	}
+
+	// Static swapchain with the background image, uploaded once
+	bool createBackgroundLayer()
+	{
+		SBackground& rBG = m_mBackground;
+		rBG.xrSwapchain.reset();
+		if (rBG.eType == EBackground::None)
+			return true;
+
+		// a format of the uploaded RGBA 8 bit pixels, sRGB encoded as the in-application sky
+		static const std::array<int64_t, 2> aFormats = { GL_SRGB8_ALPHA8, GL_RGBA8 };
+		rBG.iFormat = 0;
+		for (const auto iFormat : aFormats)
+		{
+			if (std::find(m_vSwapchainFormats.begin(), m_vSwapchainFormats.end(), iFormat) != m_vSwapchainFormats.end())
+			{
+				rBG.iFormat = iFormat;
+				break;
+			}
+		}
+		if (rBG.iFormat == 0)
+		{
+			std::cout << "Warning: the runtime has no RGBA8 swapchain format for the background layer" << std::endl;
+			return true;
+		}
+
+		const bool bCube = rBG.eType == EBackground::Cube;
+		XrSwapchainCreateInfo infoSwapchain{ XR_TYPE_SWAPCHAIN_CREATE_INFO };
+		infoSwapchain.createFlags = XR_SWAPCHAIN_CREATE_STATIC_IMAGE_BIT;
+		infoSwapchain.usageFlags = XR_SWAPCHAIN_USAGE_SAMPLED_BIT | XR_SWAPCHAIN_USAGE_TRANSFER_DST_BIT;
+		infoSwapchain.format = rBG.iFormat;
+		infoSwapchain.sampleCount = 1;
+		infoSwapchain.width = rBG.uWidth;
+		infoSwapchain.height = rBG.uHeight;
+		infoSwapchain.faceCount = bCube ? 6 : 1;
+		infoSwapchain.arraySize = 1;
+		infoSwapchain.mipCount = 1;
+		if (!check(xrCreateSwapchain(m_xrSession, &infoSwapchain, rBG.xrSwapchain.put()), "xrCreateSwapchain-background"))
+			return true;	// draw without background rather than fail the session
+
+		uint32_t uImageNum = 0;
+		std::vector<XrSwapchainImageOpenGLKHR> vImages;
+		if (check(xrEnumerateSwapchainImages(rBG.xrSwapchain, 0, &uImageNum, nullptr), "xrEnumerateSwapchainImages-1") && uImageNum > 0)
+		{
+			vImages.resize(uImageNum, { XR_TYPE_SWAPCHAIN_IMAGE_OPENGL_KHR });
+			check(xrEnumerateSwapchainImages(rBG.xrSwapchain, uImageNum, &uImageNum, (XrSwapchainImageBaseHeader*)vImages.data()), "xrEnumerateSwapchainImages-2");
+		}
+
+		uint32_t uIndex = 0;
+		XrSwapchainImageAcquireInfo ai{ XR_TYPE_SWAPCHAIN_IMAGE_ACQUIRE_INFO, nullptr };
+		XrSwapchainImageWaitInfo wi{ XR_TYPE_SWAPCHAIN_IMAGE_WAIT_INFO, nullptr, XR_INFINITE_DURATION };
+		if (vImages.empty() ||
+			!check(xrAcquireSwapchainImage(rBG.xrSwapchain, &ai, &uIndex), "xrAcquireSwapchainImage-background") ||
+			!check(xrWaitSwapchainImage(rBG.xrSwapchain, &wi), "xrWaitSwapchainImage-background"))
+		{
+			rBG.xrSwapchain.reset();
+			return true;
+		}
+
+		const GLuint glImage = vImages[uIndex].image;
+		const size_t uFaceBytes = (size_t)rBG.uWidth * rBG.uHeight * 4;
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+		if (bCube)
+		{
+			for (uint32_t uFace = 0; uFace < 6 && uFaceBytes * (uFace + 1) <= rBG.vPixels.size(); ++uFace)
+				glTextureSubImage3D(glImage, 0, 0, 0, uFace, rBG.uWidth, rBG.uHeight, 1, GL_RGBA, GL_UNSIGNED_BYTE, rBG.vPixels.data() + uFaceBytes * uFace);
+		}
+		else if (uFaceBytes <= rBG.vPixels.size())
+		{
+			glTextureSubImage2D(glImage, 0, 0, 0, rBG.uWidth, rBG.uHeight, GL_RGBA, GL_UNSIGNED_BYTE, rBG.vPixels.data());
+		}
+		glFinish();
+
+		XrSwapchainImageReleaseInfo ri{ XR_TYPE_SWAPCHAIN_IMAGE_RELEASE_INFO, nullptr };
+		check(xrReleaseSwapchainImage(rBG.xrSwapchain, &ri), "xrReleaseSwapchainImage-background");
+
+		// fixed in the reference space, at infinity
+		const XrQuaternionf xrIdentity = { 0, 0, 0, 1 };
+		if (bCube)
+		{
+			rBG.xrCubeLayer = { XR_TYPE_COMPOSITION_LAYER_CUBE_KHR, nullptr, 0, m_xrSpace, XR_EYE_VISIBILITY_BOTH, rBG.xrSwapchain, 0, xrIdentity };
+		}
+		else
+		{
+			rBG.xrEquirectLayer = { XR_TYPE_COMPOSITION_LAYER_EQUIRECT2_KHR };
+			rBG.xrEquirectLayer.space = m_xrSpace;
+			rBG.xrEquirectLayer.eyeVisibility = XR_EYE_VISIBILITY_BOTH;
+			rBG.xrEquirectLayer.subImage = { rBG.xrSwapchain, { { 0, 0 }, { (int32_t)rBG.uWidth, (int32_t)rBG.uHeight } }, 0 };
+			rBG.xrEquirectLayer.pose = { xrIdentity, { 0, 0, 0 } };
+			rBG.xrEquirectLayer.radius = 0;		// infinite
+			rBG.xrEquirectLayer.centralHorizontalAngle = 6.2831853f;
+			rBG.xrEquirectLayer.upperVerticalAngle = 1.5707963f;
+			rBG.xrEquirectLayer.lowerVerticalAngle = -1.5707963f;
+		}
+		return true;
 	}
 
 	bool prepareCompositionLayer()
 	{
+		m_vLayersPointers.clear();
 		m_vProjectionLayerViews.resize(m_vViewDatas.size());
 		for (int i = 0; i < m_vViewDatas.size(); ++i)
 		{
-			m_vProjectionLayerViews[i].type = XR_TYPE_COMPOSITION_LAYER_PROJECTION;
+			m_vProjectionLayerViews[i].type = XR_TYPE_COMPOSITION_LAYER_PROJECTION_VIEW;
 			m_vProjectionLayerViews[i].next = nullptr;
 			m_vProjectionLayerViews[i].subImage.imageArrayIndex = 0;
 			m_vProjectionLayerViews[i].subImage.swapchain = m_vViewDatas[i].m_xrSwapChain;
-			m_vProjectionLayerViews[i].subImage.imageRect.extent = { (int32_t)m_vViews[0].recommendedImageRectWidth, (int32_t)m_vViews[0].recommendedImageRectHeight };
+			m_vProjectionLayerViews[i].subImage.imageRect.extent = { (int32_t)m_vViews[i].recommendedImageRectWidth, (int32_t)m_vViews[i].recommendedImageRectHeight };
 		}
 
-		XrCompositionLayerProjection* pProjectionLayer = new XrCompositionLayerProjection{ XR_TYPE_COMPOSITION_LAYER_PROJECTION, nullptr, 0, m_xrSpace,(uint32_t)m_vProjectionLayerViews.size(), m_vProjectionLayerViews.data() };
-		m_vLayersPointers.push_back((XrCompositionLayerBaseHeader*)pProjectionLayer);
+		// layers are composited in order, the background first
+		XrCompositionLayerFlags xrProjectionFlags = 0;
+		if (m_mBackground.xrSwapchain)
+		{
+			if (m_mBackground.eType == EBackground::Cube)
+				m_vLayersPointers.push_back((XrCompositionLayerBaseHeader*)&m_mBackground.xrCubeLayer);
+			else
+				m_vLayersPointers.push_back((XrCompositionLayerBaseHeader*)&m_mBackground.xrEquirectLayer);
+			xrProjectionFlags = XR_COMPOSITION_LAYER_BLEND_TEXTURE_SOURCE_ALPHA_BIT;
+		}
+
+		m_xrProjectionLayer = { XR_TYPE_COMPOSITION_LAYER_PROJECTION, nullptr, xrProjectionFlags, m_xrSpace, (uint32_t)m_vProjectionLayerViews.size(), m_vProjectionLayerViews.data() };
+		m_vLayersPointers.push_back((XrCompositionLayerBaseHeader*)&m_xrProjectionLayer);
 
 		return true;
 	}
@@ -374,8 +1188,18 @@ protected:
 	bool createFrameBubber()
 	{
 		for (auto& rVData : m_vViewDatas)
-			glGenFramebuffers(1, &rVData.m_glFrameBuffer);
+			if (!rVData.m_glFrameBuffer)
+				glCreateFramebuffers(1, rVData.m_glFrameBuffer.put());
 
+		// the hidden area mesh is in tangent space on the z = -1 plane; put it on the near plane
+		if (m_bHasVisibilityMask && m_mMaskProgram.id() == 0)
+		{
+			const char* sMaskVS = "#version 450 core\nlayout(location = 0) uniform mat4 matProj;\nlayout(location = 0) in vec2 inPosition;\n"
+				"void main(){ vec4 vPos = matProj * vec4(inPosition, -1.0, 1.0); gl_Position = vec4(vPos.xy, -vPos.w, vPos.w); }";
+			const char* sMaskFS = "#version 450 core\nvoid main(){}";
+			if (!m_mMaskProgram.build(sMaskVS, sMaskFS))
+				m_bHasVisibilityMask = false;
+		}
 		return true;
 	}
 
@@ -412,6 +1236,28 @@ protected:
 		return matProjection;
 	}
 
+	// xrPose expressed in the space of xrBase
+	static XrPosef relativePose(const XrPosef& xrBase, const XrPosef& xrPose)
+	{
+		const XrQuaternionf& a = xrBase.orientation;
+		const XrQuaternionf& b = xrPose.orientation;
+		XrPosef xrRes;
+		xrRes.orientation = {
+			a.w * b.x - a.x * b.w - a.y * b.z + a.z * b.y,
+			a.w * b.y + a.x * b.z - a.y * b.w - a.z * b.x,
+			a.w * b.z - a.x * b.y + a.y * b.x - a.z * b.w,
+			a.w * b.w + a.x * b.x + a.y * b.y + a.z * b.z };
+
+		// rotate the offset by the inverse of the base orientation
+		const XrVector3f v{ xrPose.position.x - xrBase.position.x, xrPose.position.y - xrBase.position.y, xrPose.position.z - xrBase.position.z };
+		const XrVector3f t{ 2 * (-a.y * v.z + a.z * v.y), 2 * (-a.z * v.x + a.x * v.z), 2 * (-a.x * v.y + a.y * v.x) };
+		xrRes.position = {
+			v.x + a.w * t.x - a.y * t.z + a.z * t.y,
+			v.y + a.w * t.y - a.z * t.x + a.x * t.z,
+			v.z + a.w * t.z - a.x * t.y + a.y * t.x };
+		return xrRes;
+	}
+
 	TMatrix createModelViewMatrix(const XrPosef& xrPose)
 	{
 		// CreateFrom Quaternion
@@ -523,17 +1369,49 @@ protected:
 	}
 
 protected:
-	XrInstance	m_xrInstance;
+	// declared in creation order, so they are destroyed in reverse
+	CXrInstance	m_xrInstance;
 	XrSystemId	m_xrSystem = XR_NULL_SYSTEM_ID;
-	XrSession	m_xrSession;
-	XrSpace		m_xrSpace;
+	XrGraphicsRequirementsOpenGLKHR	m_xrGraphicsRequirements{ XR_TYPE_GRAPHICS_REQUIREMENTS_OPENGL_KHR };
+	CXrSession	m_xrSession;
+	CXrSpace	m_xrSpace;
 	XrSessionState	m_xrState = XR_SESSION_STATE_IDLE;
+	bool		m_bSessionRunning = false;
+	bool		m_bSessionLost = false;
+	std::chrono::steady_clock::time_point	m_tpRecycleTry;
+	bool		m_bRecycleOnExit = false;
+	XrViewConfigurationType	m_xrViewConfigType = XR_VIEW_CONFIGURATION_TYPE_PRIMARY_STEREO;
+
+	EFormatPolicy	m_eFormatPolicy = EFormatPolicy::SRGB;
+	int64_t			m_iSwapchainFormat = GL_SRGB8_ALPHA8;
+	uint32_t		m_uSampleCount = 1;
+	bool			m_bHasVisibilityMask = false;
+	bool			m_bHasCubeLayer = false;
+	bool			m_bHasEquirectLayer = false;
+	SBackground		m_mBackground;
+	bool			m_bUseVisibilityMask = true;
+	CGLProgram		m_mMaskProgram;
+	std::vector<int64_t>	m_vSwapchainFormats;
 
 	std::vector<XrApiLayerProperties>		m_vSupportedApiLayers;
 	std::vector<XrExtensionProperties>		m_vSupportedExtensions;
 	std::vector<XrViewConfigurationView>	m_vViews;
 	std::vector<SViewData>					m_vViewDatas;
-
+	std::vector<SViewInfo>					m_vViewInfos;
+
+	std::unique_ptr<CThreadPool>	m_pThreadPool;
+	CPerfCounter					m_perfFrame;
+	std::vector<CGPUTimer>			m_vGPUTimers;
+	bool							m_bGPUTiming = false;
+	CPerfCounter					m_perfColdStart;
+	CPerfCounter					m_perfInstance;
+	CPerfCounter					m_perfWaitInstance;
+	CPerfCounter					m_perfSession;
+	std::future<bool>				m_futInstance;
+	CPerfCounter					m_perfRecycle;
+	CCpuUsageByState				m_cpuUsage;
+
+	XrCompositionLayerProjection					m_xrProjectionLayer{ XR_TYPE_COMPOSITION_LAYER_PROJECTION };
 	std::vector<XrCompositionLayerProjectionView>	m_vProjectionLayerViews;
 	std::vector<XrCompositionLayerBaseHeader*>		m_vLayersPointers;
 
@@ -0,0 +1,223 @@
+#pragma once
+
+// Windows Header
+#include <Windows.h>
+
+#include <GL/glew.h>
+
+// STD Header
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+
+// Accumulate CPU time of a code section and how many items it processed
+class CPerfCounter
+{
+public:
+	using TClock = std::chrono::high_resolution_clock;
+
+public:
+	void begin()
+	{
+		m_tpBegin = TClock::now();
+	}
+
+	void end(uint64_t uItems = 1)
+	{
+		m_dLastMs = std::chrono::duration<double, std::milli>(TClock::now() - m_tpBegin).count();
+		m_dTotalMs += m_dLastMs;
+		m_uItems += uItems;
+		++m_uSamples;
+	}
+
+	void reset()
+	{
+		m_dTotalMs = 0;
+		m_uItems = 0;
+		m_uSamples = 0;
+	}
+
+	// Time of the last begin() / end() pair
+	double lastMs() const
+	{
+		return m_dLastMs;
+	}
+
+	double totalMs() const
+	{
+		return m_dTotalMs;
+	}
+
+	uint64_t items() const
+	{
+		return m_uItems;
+	}
+
+	uint64_t samples() const
+	{
+		return m_uSamples;
+	}
+
+	double msPerSample() const
+	{
+		return m_uSamples > 0 ? m_dTotalMs / m_uSamples : 0.0;
+	}
+
+	double usPerItem() const
+	{
+		return m_uItems > 0 ? 1000.0 * m_dTotalMs / m_uItems : 0.0;
+	}
+
+protected:
+	TClock::time_point	m_tpBegin;
+	double		m_dLastMs = 0;
+	double		m_dTotalMs = 0;
+	uint64_t	m_uItems = 0;
+	uint64_t	m_uSamples = 0;
+};
+
+// Named steps from a common origin, e.g. from static initialization to the first rendered frame
+class CTimeline
+{
+public:
+	CTimeline()
+		: m_tpOrigin(CPerfCounter::TClock::now()), m_tpLast(m_tpOrigin)
+	{
+	}
+
+	// End of a step that started at the previous mark
+	void mark(const std::string& sName)
+	{
+		const auto tpNow = CPerfCounter::TClock::now();
+		m_vSteps.push_back({ sName, std::chrono::duration<double, std::milli>(tpNow - m_tpLast).count() });
+		m_tpLast = tpNow;
+	}
+
+	double totalMs() const
+	{
+		return std::chrono::duration<double, std::milli>(m_tpLast - m_tpOrigin).count();
+	}
+
+	void print(const std::string& sTitle) const
+	{
+		std::cout << sTitle << ": " << totalMs() << " ms\n";
+		for (const auto& rStep : m_vSteps)
+			std::cout << " - " << rStep.first << ": " << rStep.second << " ms\n";
+		std::cout << std::flush;
+	}
+
+protected:
+	CPerfCounter::TClock::time_point	m_tpOrigin;
+	CPerfCounter::TClock::time_point	m_tpLast;
+	std::vector<std::pair<std::string, double>>	m_vSteps;
+};
+
+// Measure GPU time of a command range with a GL_TIME_ELAPSED query
+class CGPUTimer
+{
+public:
+	CGPUTimer() = default;
+	CGPUTimer(const CGPUTimer&) = delete;
+	CGPUTimer& operator=(const CGPUTimer&) = delete;
+
+	CGPUTimer(CGPUTimer&& rOther) noexcept
+		: m_glQuery(rOther.m_glQuery)
+	{
+		rOther.m_glQuery = 0;
+	}
+
+	~CGPUTimer()
+	{
+		if (m_glQuery != 0)
+			glDeleteQueries(1, &m_glQuery);
+	}
+
+	void begin()
+	{
+		if (m_glQuery == 0)
+			glCreateQueries(GL_TIME_ELAPSED, 1, &m_glQuery);
+		glBeginQuery(GL_TIME_ELAPSED, m_glQuery);
+	}
+
+	void end()
+	{
+		glEndQuery(GL_TIME_ELAPSED);
+	}
+
+	// Block until the result is available
+	double resultMs() const
+	{
+		GLuint64 uNs = 0;
+		glGetQueryObjectui64v(m_glQuery, GL_QUERY_RESULT, &uNs);
+		return uNs / 1000000.0;
+	}
+
+protected:
+	GLuint	m_glQuery = 0;
+};
+
+// Process CPU time (user + kernel) over wall time, accumulated per state
+class CCpuUsageByState
+{
+public:
+	struct SUsage
+	{
+		double	dCpuMs = 0;
+		double	dWallMs = 0;
+
+		// 100% is one core fully busy
+		double percent() const
+		{
+			return dWallMs > 0 ? 100.0 * dCpuMs / dWallMs : 0.0;
+		}
+	};
+
+public:
+	void enter(int iState)
+	{
+		const double dCpuMs = processCpuMs();
+		const auto tpNow = std::chrono::steady_clock::now();
+		if (m_bStarted)
+		{
+			SUsage& rUsage = m_mapUsage[m_iState];
+			rUsage.dCpuMs += dCpuMs - m_dCpuMs;
+			rUsage.dWallMs += std::chrono::duration<double, std::milli>(tpNow - m_tpWall).count();
+		}
+
+		m_bStarted = true;
+		m_iState = iState;
+		m_dCpuMs = dCpuMs;
+		m_tpWall = tpNow;
+	}
+
+	// Close the current interval, and keep counting for the same state
+	const std::map<int, SUsage>& usage()
+	{
+		if (m_bStarted)
+			enter(m_iState);
+		return m_mapUsage;
+	}
+
+	static double processCpuMs()
+	{
+		FILETIME ftCreate, ftExit, ftKernel, ftUser;
+		if (!GetProcessTimes(GetCurrentProcess(), &ftCreate, &ftExit, &ftKernel, &ftUser))
+			return 0;
+
+		auto toMs = [](const FILETIME& ft) {
+			return (((uint64_t)ft.dwHighDateTime << 32) | ft.dwLowDateTime) / 10000.0;
+		};
+		return toMs(ftKernel) + toMs(ftUser);
+	}
+
+protected:
+	bool	m_bStarted = false;
+	int		m_iState = 0;
+	double	m_dCpuMs = 0;
+	std::chrono::steady_clock::time_point	m_tpWall;
+
+	std::map<int, SUsage>	m_mapUsage;
+};
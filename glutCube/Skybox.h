@@ -0,0 +1,154 @@
+#pragma once
+
+#include <GL/glew.h>
+
+#include "GLShader.h"
+#include "Handle.h"
+#include "OpenXRGL.h"
+
+// STD Header
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+// A procedural sky, as RGBA 8 bit images for a compositor background layer or for drawing in the application
+class CSkybox
+{
+public:
+	// Color of the sky in a direction: a gradient with a line every 15 degrees of latitude and longitude
+	static void skyColor(float x, float y, float z, uint8_t* pRGBA)
+	{
+		const float fLength = sqrtf(x * x + y * y + z * z);
+		const float fLat = asinf((std::max)(-1.0f, (std::min)(1.0f, y / fLength)));
+		const float fLon = atan2f(x, -z);
+
+		const float fStep = 3.14159265f / 12;
+		const float fLatGrid = fabsf(fLat / fStep - roundf(fLat / fStep));
+		const float fLonGrid = fabsf(fLon / fStep - roundf(fLon / fStep));
+		const bool bLine = (std::min)(fLatGrid, fLonGrid) < 0.02f;
+
+		const float fUp = (std::max)(0.0f, y / fLength);
+		const float fDown = (std::max)(0.0f, -y / fLength);
+		float vColor[3] = { 0.55f - 0.35f * fUp - 0.3f * fDown, 0.7f - 0.3f * fUp - 0.4f * fDown, 0.95f - 0.1f * fUp - 0.6f * fDown };
+		if (bLine)
+			vColor[0] = vColor[1] = vColor[2] = 0.9f;
+
+		for (int i = 0; i < 3; ++i)
+			pRGBA[i] = (uint8_t)(255 * (std::max)(0.0f, (std::min)(1.0f, vColor[i])));
+		pRGBA[3] = 255;
+	}
+
+	// 6 faces in GL order (+X, -X, +Y, -Y, +Z, -Z), first row at the top as GL cube maps expect
+	static std::vector<uint8_t> generateCubeFaces(uint32_t uSize)
+	{
+		std::vector<uint8_t> vPixels((size_t)uSize * uSize * 4 * 6);
+		for (uint32_t uFace = 0; uFace < 6; ++uFace)
+		{
+			for (uint32_t y = 0; y < uSize; ++y)
+			{
+				for (uint32_t x = 0; x < uSize; ++x)
+				{
+					const float s = 2 * (x + 0.5f) / uSize - 1, t = 2 * (y + 0.5f) / uSize - 1;
+					float d[3];
+					switch (uFace)
+					{
+					case 0:	d[0] = 1;	d[1] = -t;	d[2] = -s;	break;
+					case 1:	d[0] = -1;	d[1] = -t;	d[2] = s;	break;
+					case 2:	d[0] = s;	d[1] = 1;	d[2] = t;	break;
+					case 3:	d[0] = s;	d[1] = -1;	d[2] = -t;	break;
+					case 4:	d[0] = s;	d[1] = -t;	d[2] = 1;	break;
+					default:d[0] = -s;	d[1] = -t;	d[2] = -1;	break;
+					}
+					skyColor(d[0], d[1], d[2], &vPixels[(((size_t)uFace * uSize + y) * uSize + x) * 4]);
+				}
+			}
+		}
+		return vPixels;
+	}
+
+	// Full sphere, -Z at the image center and +Y at the top
+	static std::vector<uint8_t> generateEquirect(uint32_t uWidth, uint32_t uHeight)
+	{
+		std::vector<uint8_t> vPixels((size_t)uWidth * uHeight * 4);
+		for (uint32_t y = 0; y < uHeight; ++y)
+		{
+			const float fLat = (0.5f - (y + 0.5f) / uHeight) * 3.14159265f;
+			for (uint32_t x = 0; x < uWidth; ++x)
+			{
+				const float fLon = ((x + 0.5f) / uWidth - 0.5f) * 2 * 3.14159265f;
+				skyColor(cosf(fLat) * sinf(fLon), sinf(fLat), -cosf(fLat) * cosf(fLon), &vPixels[((size_t)y * uWidth + x) * 4]);
+			}
+		}
+		return vPixels;
+	}
+
+public:
+	bool create(uint32_t uSize)
+	{
+		const std::vector<uint8_t> vPixels = generateCubeFaces(uSize);
+		glCreateTextures(GL_TEXTURE_CUBE_MAP, 1, m_glTexture.put());
+		glTextureStorage2D(m_glTexture, 1, GL_SRGB8_ALPHA8, uSize, uSize);
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+		for (uint32_t uFace = 0; uFace < 6; ++uFace)
+			glTextureSubImage3D(m_glTexture, 0, 0, 0, uFace, uSize, uSize, 1, GL_RGBA, GL_UNSIGNED_BYTE, vPixels.data() + (size_t)uSize * uSize * 4 * uFace);
+		glTextureParameteri(m_glTexture, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		glTextureParameteri(m_glTexture, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glCreateVertexArrays(1, m_glVAO.put());
+
+		// full-view triangle on the far plane, the direction from the inverse projection and view rotation;
+		// the projection has an infinite far plane, so the far plane unprojects to w = 0 and xyz is the direction
+		const char* sVS = R"(
+#version 450 core
+layout(location = 0) uniform mat4 matProj;
+layout(location = 1) uniform mat4 matView;
+out vec3 vsDir;
+void main()
+{
+	vec2 vPos = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2) * 2.0 - 1.0;
+	vec4 vEye = inverse(matProj) * vec4(vPos, 1.0, 1.0);
+	vsDir = transpose(mat3(matView)) * vEye.xyz;
+	gl_Position = vec4(vPos, 1.0, 1.0);
+}
+)";
+		const char* sFS = R"(
+#version 450 core
+layout(binding = 0) uniform samplerCube texSky;
+in vec3 vsDir;
+out vec4 outColor;
+void main()
+{
+	outColor = texture(texSky, vsDir);
+}
+)";
+		return m_mProgram.build(sVS, sFS);
+	}
+
+	void release()
+	{
+		m_mProgram.release();
+		m_glTexture.reset();
+		m_glVAO.reset();
+	}
+
+	// Draw after the opaque scene, so the depth test rejects covered pixels
+	void draw(const COpenXRGL::SViewInfo& rView)
+	{
+		glDepthFunc(GL_LEQUAL);
+		glDepthMask(GL_FALSE);
+		glDisable(GL_CULL_FACE);
+		m_mProgram.use();
+		glProgramUniformMatrix4fv(m_mProgram.id(), 0, 1, GL_FALSE, rView.matProjection.data());
+		glProgramUniformMatrix4fv(m_mProgram.id(), 1, 1, GL_FALSE, rView.matModelView.data());
+		glBindTextureUnit(0, m_glTexture);
+		glBindVertexArray(m_glVAO);
+		glDrawArrays(GL_TRIANGLES, 0, 3);
+		glEnable(GL_CULL_FACE);
+		glDepthMask(GL_TRUE);
+		glDepthFunc(GL_LESS);
+	}
+
+protected:
+	CGLProgram		m_mProgram;
+	CGLTexture		m_glTexture;
+	CGLVertexArray	m_glVAO;
+};
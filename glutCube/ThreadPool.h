@@ -0,0 +1,116 @@
+#pragma once
+
+// STD Header
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+// A fixed size pool of worker threads
+class CThreadPool
+{
+public:
+	using TTask = std::function<void()>;
+
+public:
+	explicit CThreadPool(size_t uThreadNum = (std::max)(2u, std::thread::hardware_concurrency()) - 1)
+	{
+		for (size_t i = 0; i < uThreadNum; ++i)
+			m_vWorkers.emplace_back([this]() { workerLoop(); });
+	}
+
+	CThreadPool(const CThreadPool&) = delete;
+	CThreadPool& operator=(const CThreadPool&) = delete;
+
+	~CThreadPool()
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_bStop = true;
+		}
+		m_cvTask.notify_all();
+		for (auto& rThread : m_vWorkers)
+			rThread.join();
+	}
+
+	size_t size() const
+	{
+		return m_vWorkers.size();
+	}
+
+	void push(TTask funcTask)
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_qTasks.push(std::move(funcTask));
+		}
+		m_cvTask.notify_one();
+	}
+
+	// Run func(i) for i in [0, uCount) on the pool and the calling thread, and wait for all of them
+	template<typename FUNC>
+	void parallelFor(size_t uCount, FUNC func)
+	{
+		if (uCount == 0)
+			return;
+		if (uCount == 1 || m_vWorkers.empty())
+		{
+			for (size_t i = 0; i < uCount; ++i)
+				func(i);
+			return;
+		}
+
+		const size_t uHelpers = (std::min)(uCount - 1, m_vWorkers.size());
+		std::atomic<size_t> uNext{ 0 };
+		size_t uExited = 0;
+		std::mutex mtxDone;
+		std::condition_variable cvDone;
+
+		// every runner checks out under the lock, so the locals stay alive until the last one left
+		auto funcRun = [&]() {
+			for (size_t i = uNext++; i < uCount; i = uNext++)
+				func(i);
+
+			std::lock_guard<std::mutex> lock(mtxDone);
+			if (++uExited == uHelpers + 1)
+				cvDone.notify_one();
+		};
+
+		for (size_t i = 0; i < uHelpers; ++i)
+			push(funcRun);
+		funcRun();
+
+		std::unique_lock<std::mutex> lock(mtxDone);
+		cvDone.wait(lock, [&]() { return uExited == uHelpers + 1; });
+	}
+
+protected:
+	void workerLoop()
+	{
+		while (true)
+		{
+			TTask funcTask;
+			{
+				std::unique_lock<std::mutex> lock(m_mutex);
+				m_cvTask.wait(lock, [this]() { return m_bStop || !m_qTasks.empty(); });
+				if (m_bStop && m_qTasks.empty())
+					return;
+
+				funcTask = std::move(m_qTasks.front());
+				m_qTasks.pop();
+			}
+			funcTask();
+		}
+	}
+
+protected:
+	std::vector<std::thread>	m_vWorkers;
+	std::queue<TTask>			m_qTasks;
+	std::mutex					m_mutex;
+	std::condition_variable		m_cvTask;
+	bool						m_bStop = false;
+};
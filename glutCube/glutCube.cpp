@@ -1,10 +1,17 @@
 // The OpenGL sample is from https://www.opengl.org/archives/resources/code/samples/glut_examples/examples/cube.c
 
 #include "OpenXRGL.h"
+#include "GLShader.h"
+#include "GLUniformRing.h"
+#include "PerfCounter.h"
+#include "BenchmarkScene.h"
+#include "AssetStream.h"
+#include "Skybox.h"
+#include "ClusteredLights.h"
 
 // OpenGL related Headers
 #include <GL/glew.h>
-#include <GL/glut.h>
+#include <GL/freeglut.h>
 
 // link lib
 #pragma comment(lib,"freeglut.lib")
@@ -18,46 +25,377 @@ GLint faces[6][4] = {  /* Vertex indices for the 6 faces of a cube. */
 	{0, 1, 2, 3}, {3, 2, 6, 7}, {7, 6, 5, 4},
 	{4, 5, 1, 0}, {5, 6, 2, 1}, {7, 4, 0, 3} };
 GLfloat v[8][3];  /* Will be filled in with X,Y,Z vertexes. */
+
+CGLVertexArray	gCubeVAO;
+CGLBuffer		gCubeBuffers[2];	/* vertex buffer, index buffer */
+GLsizei	gCubeIndexNum = 0;
+#pragma endregion
+
+#pragma region Shader pipeline data
+/* Per-frame, per-view and per-object constants, laid out as std140 blocks. */
+struct SFrameConstants
+{
+	GLfloat				vAmbient[4];
+	SClusterConstants	mCluster;
+};
+
+struct SViewConstants
+{
+	COpenXRGL::TMatrix	matProj;
+	COpenXRGL::TMatrix	matView;
+};
+
+struct SObjectConstants
+{
+	COpenXRGL::TMatrix	matModel;
+	GLfloat	vDiffuse[4];
+};
+
+const char* gsVertexShader = R"(
+#version 450 core
+layout(std140, binding = 1) uniform ViewBlock { mat4 matProj; mat4 matView; };
+layout(std140, binding = 2) uniform ObjectBlock { mat4 matModel; vec4 vDiffuse; };
+
+layout(location = 0) in vec3 inPosition;
+layout(location = 1) in vec3 inNormal;
+
+out vec3 vsPosition;
+out vec3 vsNormal;
+out vec3 vsObjectNormal;
+
+void main()
+{
+	vec4 vPosition = matModel * vec4(inPosition, 1.0);
+	vsPosition = vPosition.xyz;
+	vsNormal = mat3(matModel) * inNormal;
+	vsObjectNormal = inNormal;
+	gl_Position = matProj * matView * vPosition;
+}
+)";
+
+/* Lit in scene space by the point lights of the fragment's cluster, appended to CClusteredLights::shaderSource(). */
+const char* gsFragmentShader = R"(
+layout(std140, binding = 0) uniform FrameBlock { vec4 vAmbient; mat4 matCluster; vec4 vTangents; vec4 vDepth; uvec4 uGrid; };
+layout(std140, binding = 2) uniform ObjectBlock { mat4 matModel; vec4 vDiffuse; };
+layout(location = 0) uniform bool bTextured;		/* streamed meshes, spherical mapping of the object space normal */
+layout(binding = 0) uniform sampler2D texDiffuse;
+
+in vec3 vsPosition;
+in vec3 vsNormal;
+in vec3 vsObjectNormal;
+out vec4 outColor;
+
+void main()
+{
+	vec3 vN = normalize(vsNormal);
+	vec3 vAlbedo = vDiffuse.rgb;
+	if (bTextured)
+	{
+		vec3 vON = normalize(vsObjectNormal);
+		vAlbedo *= texture(texDiffuse, vec2(atan(vON.x, -vON.z) * 0.1591549 + 0.5, acos(clamp(vON.y, -1.0, 1.0)) * 0.3183099)).rgb;
+	}
+	vec3 vColor = vAmbient.rgb + clusteredLight(vsPosition, vN, vAlbedo, matCluster, vTangents, vDepth, uGrid);
+	outColor = vec4(vColor, vDiffuse.a);
+}
+)";
+
+CGLProgram			gProgram;
+CGLUniformRing<3>	gUniformRing;
+SFrameConstants		gFrameConstants;
+SObjectConstants	gCubeConstants;
 #pragma endregion
 
+#pragma region Clustered lights
+CClusteredLights	gLights;
+uint32_t			gLightNum = 0;			/* 0: the red and green lights of the original sample, or gSceneLightNum with --scene */
+const uint32_t		gSceneLightNum = 64;	/* enough range to light the whole benchmark scene box */
+bool				gBenchmarkLights = false;	/* step the light number from 8 to 4096, gBenchmarkFrames each */
+const uint32_t		gBenchmarkMaxLights = 4096;
+const float			gLightBoxMin[3] = { -5.0f, -2.0f, -5.0f };	/* the volume of the benchmark scene */
+const float			gLightBoxMax[3] = { 5.0f, 2.0f, 5.0f };
+#pragma endregion
+
+#pragma region Per-view work
+/* Filled in parallel for each view before GL submission. */
+struct SViewWork
+{
+	COpenXRGL::SViewInfo	mView;		/* the view as rendered; in scene mode relative to the scripted camera */
+	SViewConstants			mConstants;
+	std::vector<uint32_t>	vVisibleObjects;
+};
+
+std::vector<SViewWork>	gViewWorks;
+
+#pragma endregion
+
+#pragma region Benchmark scene
+bool				gUseScene = false;
+SSceneConfig		gSceneConfig;
+CBenchmarkScene		gScene;
+CScriptedPoseSource	gPoseSource;
+CBenchmarkRecorder	gRecorder;
+uint64_t			gBenchmarkFrames = 0;	/* 0: run until the window is closed */
+std::string			gResultFile = "benchmark_results.csv";
+std::string			gResultLabel = "default";
+
+uint32_t	gFrameDrawCalls = 0;
+bool		gFrameRendered = false;
+#pragma endregion
+
+#pragma region Background
+/* A sky drawn by the compositor as a cube or equirect layer, or by the application for comparison. */
+std::string	gSkyboxMode = "none";
+uint32_t	gSkyboxSize = 1024;
+CSkybox		gSkybox;
+bool		gDrawSkybox = false;
+#pragma endregion
+
+#pragma region Streamed assets
+CAssetStreamer			gAssetStreamer;
+std::vector<std::string>	gMeshFiles;
+std::vector<std::string>	gTextureFiles;
+std::vector<uint32_t>	gMeshIds;
+std::vector<uint32_t>	gTextureIds;		/* mesh i is drawn with texture i % count once both are resident */
+double					gFrameBoundMs = 11.0;	/* upload slices shrink when a frame takes longer */
+#pragma endregion
+
+CPerfCounter	gDrawCounter;
+CTimeline		gStartup;		/* from static initialization to the first rendered frame */
+bool			gFirstFrameShown = false;
+std::string		gShaderCacheDir = "shader_cache";
+
 COpenXRGL gXRGL;
 
 
 void drawBox(void)
 {
-	for (int i = 0; i < 6; i++) {
-		glBegin(GL_QUADS);
-		glNormal3fv(&n[i][0]);
-		glVertex3fv(&v[faces[i][0]][0]);
-		glVertex3fv(&v[faces[i][1]][0]);
-		glVertex3fv(&v[faces[i][2]][0]);
-		glVertex3fv(&v[faces[i][3]][0]);
-		glEnd();
+	glBindVertexArray(gCubeVAO);
+	glDrawElements(GL_TRIANGLES, gCubeIndexNum, GL_UNSIGNED_INT, nullptr);
+}
+
+/* Scale a streamed mesh to the cube size and put it on the right of the cube. */
+void drawStreamedMesh(uint32_t uIdx)
+{
+	const CAssetStreamer::SMesh* pMesh = gAssetStreamer.getMesh(gMeshIds[uIdx]);
+	const float fScale = 0.1f / (std::max)(pMesh->fBoundRadius, 1e-6f);
+	SObjectConstants mConstants = gCubeConstants;
+	mConstants.matModel = {
+		fScale, 0, 0, 0,
+		0, fScale, 0, 0,
+		0, 0, fScale, 0,
+		0.3f * (uIdx + 1) - pMesh->vBoundCenter[0] * fScale, -pMesh->vBoundCenter[1] * fScale, -pMesh->vBoundCenter[2] * fScale, 1 };
+	gUniformRing.bind(2, mConstants);
+
+	const CAssetStreamer::STexture* pTexture = gTextureIds.empty() ? nullptr : gAssetStreamer.getTexture(gTextureIds[uIdx % gTextureIds.size()]);
+	if (pTexture != nullptr)
+	{
+		glBindTextureUnit(0, pTexture->glTexture);
+		glProgramUniform1i(gProgram.id(), 0, GL_TRUE);
 	}
+
+	glBindVertexArray(pMesh->glVAO);
+	glDrawElements(GL_TRIANGLES, pMesh->iIndexNum, GL_UNSIGNED_INT, nullptr);
+
+	if (pTexture != nullptr)
+		glProgramUniform1i(gProgram.id(), 0, GL_FALSE);
 }
 
 void display(void)
 {
 	gXRGL.processEvent();
-	gXRGL.draw([](const COpenXRGL::TMatrix& matProj, const COpenXRGL::TMatrix& matModelView) {
-		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+	if (gXRGL.getSessionState() == XR_SESSION_STATE_EXITING)
+	{
+		glutLeaveMainLoop();
+		return;
+	}
 
-		/* Setup the view of the cube. */
-		glMatrixMode(GL_PROJECTION);
-		glLoadIdentity();
-		glMultMatrixf(matProj.data());
+	if (!gMeshIds.empty() || !gTextureFiles.empty())
+		gAssetStreamer.update((std::max)(gXRGL.getFrameCounter().lastMs(), gXRGL.getFrameGPUMs()));
+
+	gFrameRendered = false;
+	gFrameDrawCalls = 0;
+	if (gUseScene)
+		gRecorder.beginFrame();
+	const COpenXRGL::TMatrix matWorld = gPoseSource.getWorldMatrix(gRecorder.frames());
+
+	gUniformRing.beginFrame();
+	const bool bRendered = gXRGL.draw([&matWorld](uint32_t uViewIdx, const COpenXRGL::SViewInfo& rView) {
+		/* Per-view CPU work, run on the thread pool. */
+		SViewWork& rWork = gViewWorks[uViewIdx];
+		rWork.mView = rView;
+		rWork.vVisibleObjects.clear();
+		if (gUseScene)
+		{
+			/* The scripted camera replaces the located head pose, only the eye offsets are kept, so every run has the same load. */
+			rWork.mView.matModelView = rView.matEyeView;
+			rWork.mConstants = { rView.matProjection, CBenchmarkScene::multiply(rWork.mView.matModelView, matWorld) };
+			gScene.prepareView(uViewIdx, rWork.mView, matWorld);
+		}
+		else
+		{
+			rWork.mConstants = { rView.matProjection, rView.matModelView };
+			if (CBenchmarkScene::isSphereInView(rView, &gCubeConstants.matModel[12], 0.18f))
+				rWork.vVisibleObjects.push_back(0);
+
+			/* Streamed meshes, from index 1; skipped until resident. */
+			for (uint32_t i = 0; i < gMeshIds.size(); ++i)
+			{
+				const CAssetStreamer::SMesh* pMesh = gAssetStreamer.getMesh(gMeshIds[i]);
+				if (pMesh == nullptr)
+					continue;
+
+				const float vCenter[3] = { 0.3f * (i + 1), 0, 0 };
+				if (CBenchmarkScene::isSphereInView(rView, vCenter, 0.1f))
+					rWork.vVisibleObjects.push_back(i + 1);
+			}
+		}
+	}, [&matWorld](uint32_t uViewIdx, const COpenXRGL::SViewInfo& rView) {
+		gFrameRendered = true;
+
+		/* Lights and levels of detail are chosen once for all views, after every view is prepared. */
+		if (uViewIdx == 0)
+		{
+			if (gUseScene)
+			{
+				std::vector<COpenXRGL::SViewInfo> vViews(gViewWorks.size());
+				for (size_t i = 0; i < gViewWorks.size(); ++i)
+					vViews[i] = gViewWorks[i].mView;
+				gScene.selectLOD(vViews, matWorld);
+			}
 
-		glMatrixMode(GL_MODELVIEW);
-		glLoadIdentity();
-		glMultMatrixf(matModelView.data());
+			std::vector<COpenXRGL::TMatrix> vViewMatrices(gViewWorks.size());
+			for (size_t i = 0; i < gViewWorks.size(); ++i)
+				vViewMatrices[i] = gViewWorks[i].mConstants.matView;
+			gLights.update(gXRGL.getViewInfos(), vViewMatrices);
+			gFrameConstants.mCluster = gLights.constants();
+			gUniformRing.bind(0, gFrameConstants);
+		}
 
-		//glTranslatef(0.0, 0.0, -1.0);
-		//glRotatef(60, 1.0, 0.0, 0.0);
-		//glRotatef(-20, 0.0, 0.0, 1.0);
+		/* Setup the view of the cube. */
+		const SViewWork& rWork = gViewWorks[uViewIdx];
+		gProgram.use();
+		gUniformRing.bind(1, rWork.mConstants);
 
-		drawBox();
+		gDrawCounter.begin();
+		uint32_t uDrawCalls = 0;
+		if (gUseScene)
+		{
+			uDrawCalls = gScene.drawView(uViewIdx, gUniformRing);
+		}
+		else
+		{
+			for (const uint32_t uObject : rWork.vVisibleObjects)
+			{
+				if (uObject == 0)
+				{
+					gUniformRing.bind(2, gCubeConstants);
+					drawBox();
+				}
+				else
+				{
+					drawStreamedMesh(uObject - 1);
+				}
+				++uDrawCalls;
+			}
+		}
+		if (gDrawSkybox)
+		{
+			COpenXRGL::SViewInfo mSkyView = rWork.mView;
+			mSkyView.matModelView = rWork.mConstants.matView;
+			gSkybox.draw(mSkyView);
+			++uDrawCalls;
+		}
+		if (gUseScene)
+			uDrawCalls += gScene.drawOverdraw();
+		gDrawCounter.end(uDrawCalls);
+		gFrameDrawCalls += uDrawCalls;
 	});
-	glutSwapBuffers();
+	gUniformRing.endFrame();
+	if (gFrameRendered)
+		gLights.endFrame();
+
+	if (gUseScene && gFrameRendered)
+	{
+		gRecorder.endFrame(gXRGL.getFrameCounter().lastMs(), gXRGL.getFrameGPUMs(), gFrameDrawCalls);
+
+		if (gBenchmarkLights && gRecorder.frames() >= gBenchmarkFrames)
+		{
+			CPerfCounter& rAssign = gLights.getAssignCounter();
+			std::cout << gLights.lightCount() << " lights: light assignment " << rAssign.msPerSample() << " ms"
+				<< ", " << gLights.lightsPerCluster() << " lights/cluster, " << gLights.droppedIndices() << " dropped" << std::endl;
+			gRecorder.write(gResultFile, gResultLabel + "-lights-" + std::to_string(gLights.lightCount()), gSceneConfig, gXRGL.getViewCount());
+
+			if (gLightNum >= gBenchmarkMaxLights)
+			{
+				glutLeaveMainLoop();
+			}
+			else
+			{
+				gLightNum *= 2;
+				gLights.setLights(CClusteredLights::generate(gLightNum, gSceneConfig.uSeed, gLightBoxMin, gLightBoxMax));
+				rAssign.reset();
+				gRecorder = CBenchmarkRecorder();
+			}
+		}
+		else if (gBenchmarkFrames > 0 && gRecorder.frames() >= gBenchmarkFrames)
+		{
+			gRecorder.write(gResultFile, gResultLabel, gSceneConfig, gXRGL.getViewCount());
+			glutLeaveMainLoop();
+		}
+	}
+
+	CPerfCounter& rFrameCounter = gXRGL.getFrameCounter();
+	if (rFrameCounter.samples() >= 1000)
+	{
+		std::cout << "CPU frame: " << rFrameCounter.msPerSample() << " ms with " << gXRGL.getViewCount() << " views"
+			<< ", draw submission: " << gDrawCounter.usPerItem() << " us/draw (" << gDrawCounter.items() << " draws)" << std::endl;
+		if (gUseScene && gScene.fullDetailTriangles() > 0)
+		{
+			std::cout << "LOD: " << 100.0 * gScene.drawnTriangles() / gScene.fullDetailTriangles() << "% of full detail triangles"
+				<< ", selection " << gScene.getLODCounter().msPerSample() << " ms/frame" << std::endl;
+			gScene.resetTriangleCount();
+			gScene.getLODCounter().reset();
+		}
+		rFrameCounter.reset();
+		gDrawCounter.reset();
+	}
+
+	/* Nothing new in the back buffer when the runtime did not ask for rendering. */
+	if (bRendered)
+		glutSwapBuffers();
+
+	if (bRendered && !gFirstFrameShown)
+	{
+		gFirstFrameShown = true;
+		gStartup.mark("session start and first frame");
+		gStartup.print("Time to first frame");
+	}
+}
+
+/* The window is destroyed when the main loop returns; free GL objects and the OpenXR session while its context is still current. */
+void releaseGL(void)
+{
+	gAssetStreamer.stop();
+	gLights.release();
+	gScene.release();
+	gSkybox.release();
+	gProgram.release();
+	gUniformRing.release();
+	gCubeVAO.reset();
+	gCubeBuffers[0].reset();
+	gCubeBuffers[1].reset();
+	gXRGL.releaseSession();
+	gXRGL.releaseGraphics();
+}
+
+/* Only drive the frame loop while the session is running, xrWaitFrame() paces it then; otherwise block on events. */
+void idle(void)
+{
+	if (!gXRGL.isSessionRunning())
+		gXRGL.waitEvent(100);
+
+	if (gXRGL.isSessionRunning() || gXRGL.getSessionState() == XR_SESSION_STATE_EXITING)
+		glutPostRedisplay();
 }
 
 void initGL(void)
@@ -70,22 +408,46 @@ void initGL(void)
 	v[0][2] = v[3][2] = v[4][2] = v[7][2] = 0.1;
 	v[1][2] = v[2][2] = v[5][2] = v[6][2] = -0.1;
 
-	/* Enable a single OpenGL light. */
-	{
-		GLfloat light_diffuse[] = { 1.0, 0.0, 0.0, 1.0 };  /* Red diffuse light. */
-		GLfloat light_position[] = { 1.0, 1.0, 1.0, 0.0 };  /* Infinite light location. */
-		glLightfv(GL_LIGHT0, GL_DIFFUSE, light_diffuse);
-		glLightfv(GL_LIGHT0, GL_POSITION, light_position);
-	}
+	/* Expand the faces into a vertex buffer with per-face normals, and split quads into triangles. */
 	{
-		GLfloat light_diffuse[] = { 0.0, 1.0, 0.0, 1.0 };  /* Red diffuse light. */
-		GLfloat light_position[] = { -1.0, 1.0, -1.0, 0.0 };  /* Infinite light location. */
-		glLightfv(GL_LIGHT1, GL_DIFFUSE, light_diffuse);
-		glLightfv(GL_LIGHT1, GL_POSITION, light_position);
+		std::vector<GLfloat> vVertices;
+		std::vector<GLuint> vIndices;
+		for (int i = 0; i < 6; i++) {
+			GLuint uBase = (GLuint)(vVertices.size() / 6);
+			for (int j = 0; j < 4; j++) {
+				vVertices.insert(vVertices.end(), &v[faces[i][j]][0], &v[faces[i][j]][0] + 3);
+				vVertices.insert(vVertices.end(), &n[i][0], &n[i][0] + 3);
+			}
+			vIndices.insert(vIndices.end(), { uBase, uBase + 1, uBase + 2, uBase, uBase + 2, uBase + 3 });
+		}
+		gCubeIndexNum = (GLsizei)vIndices.size();
+
+		glCreateBuffers(1, gCubeBuffers[0].put());
+		glCreateBuffers(1, gCubeBuffers[1].put());
+		glNamedBufferStorage(gCubeBuffers[0], vVertices.size() * sizeof(GLfloat), vVertices.data(), 0);
+		glNamedBufferStorage(gCubeBuffers[1], vIndices.size() * sizeof(GLuint), vIndices.data(), 0);
+
+		glCreateVertexArrays(1, gCubeVAO.put());
+		glVertexArrayVertexBuffer(gCubeVAO, 0, gCubeBuffers[0], 0, 6 * sizeof(GLfloat));
+		glVertexArrayElementBuffer(gCubeVAO, gCubeBuffers[1]);
+		glEnableVertexArrayAttrib(gCubeVAO, 0);
+		glVertexArrayAttribFormat(gCubeVAO, 0, 3, GL_FLOAT, GL_FALSE, 0);
+		glVertexArrayAttribBinding(gCubeVAO, 0, 0);
+		glEnableVertexArrayAttrib(gCubeVAO, 1);
+		glVertexArrayAttribFormat(gCubeVAO, 1, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(GLfloat));
+		glVertexArrayAttribBinding(gCubeVAO, 1, 0);
 	}
-	glEnable(GL_LIGHT0);
-	glEnable(GL_LIGHT1);
-	glEnable(GL_LIGHTING);
+
+	gFrameConstants = {
+		{ 0.04f, 0.04f, 0.04f, 1.0 }							/* default global ambient * material ambient */
+	};
+	gCubeConstants = {
+		{ 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1 },
+		{ 0.8f, 0.8f, 0.8f, 1.0 }								/* default material diffuse */
+	};
+
+	gProgram.build(gsVertexShader, std::string("#version 450 core\n") + CClusteredLights::shaderSource() + gsFragmentShader);
+	gUniformRing.create(64 * 1024);
 
 	/* Use depth buffering for hidden surface elimination. */
 	glEnable(GL_DEPTH_TEST);
@@ -93,20 +455,398 @@ void initGL(void)
 	glFrontFace(GL_CW);
 }
 
+/* Compare fill and blit throughput of every supported swapchain format at swapchain size. */
+void benchmarkSwapchainFormats(void)
+{
+	const char* sFillVS = "#version 450 core\nvoid main(){ gl_Position = vec4(vec2((gl_VertexID << 1) & 2, gl_VertexID & 2) * 2.0 - 1.0, 0.0, 1.0); }";
+	const char* sFillFS = "#version 450 core\nout vec4 outColor; void main(){ outColor = vec4(0.25, 0.5, 0.75, 1.0); }";
+	CGLProgram mFillProgram;
+	if (!mFillProgram.build(sFillVS, sFillFS))
+		return;
+
+	const GLsizei iWidth = (GLsizei)gXRGL.getSwapchainWidth(), iHeight = (GLsizei)gXRGL.getSwapchainHeight();
+	const int iLoops = 100;
+	const double dGPixel = (double)iWidth * iHeight * iLoops / 1e9;
+
+	CGLVertexArray glVAO;
+	glCreateVertexArrays(1, glVAO.put());
+
+	std::cout << "Swapchain format benchmark (" << iWidth << " * " << iHeight << ", " << iLoops << " loops)\n";
+	for (const auto& iFormat : gXRGL.getSwapchainFormats())
+	{
+		CGLTexture glTextures[2];
+		CGLFramebuffer glFBOs[2];
+		for (int i = 0; i < 2; ++i)
+		{
+			glCreateTextures(GL_TEXTURE_2D, 1, glTextures[i].put());
+			glCreateFramebuffers(1, glFBOs[i].put());
+			glTextureStorage2D(glTextures[i], 1, (GLenum)iFormat, iWidth, iHeight);
+			glNamedFramebufferTexture(glFBOs[i], GL_COLOR_ATTACHMENT0, glTextures[i], 0);
+		}
+
+		CGPUTimer mFillTimer, mBlitTimer;
+		if (glCheckNamedFramebufferStatus(glFBOs[0], GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE)
+		{
+			glBindFramebuffer(GL_FRAMEBUFFER, glFBOs[0]);
+			glViewport(0, 0, iWidth, iHeight);
+			glDisable(GL_DEPTH_TEST);
+			glDisable(GL_CULL_FACE);
+			mFillProgram.use();
+			glBindVertexArray(glVAO);
+
+			mFillTimer.begin();
+			for (int i = 0; i < iLoops; ++i)
+				glDrawArrays(GL_TRIANGLES, 0, 3);
+			mFillTimer.end();
+
+			mBlitTimer.begin();
+			for (int i = 0; i < iLoops; ++i)
+				glBlitNamedFramebuffer(glFBOs[i % 2], glFBOs[(i + 1) % 2], 0, 0, iWidth, iHeight, 0, 0, iWidth, iHeight, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+			mBlitTimer.end();
+
+			glBindFramebuffer(GL_FRAMEBUFFER, 0);
+			glEnable(GL_DEPTH_TEST);
+			glEnable(GL_CULL_FACE);
+
+			const double dFillMs = mFillTimer.resultMs(), dBlitMs = mBlitTimer.resultMs();
+			std::cout << " - " << COpenXRGL::getFormatInfo(iFormat).sName
+				<< ": fill " << dFillMs / iLoops << " ms (" << dGPixel / (dFillMs / 1000) << " GPixel/s)"
+				<< ", blit " << dBlitMs / iLoops << " ms (" << dGPixel / (dBlitMs / 1000) << " GPixel/s)\n";
+		}
+		else
+		{
+			std::cout << " - " << COpenXRGL::getFormatInfo(iFormat).sName << ": not renderable\n";
+		}
+	}
+	std::cout << std::endl;
+}
+
+/* LOD selection over 100k instances of the scene mesh, seen from the scripted camera with the swapchain size of the
+   runtime and a typical headset field of view; only CPU work, the views of a running session are not needed. */
+void benchmarkLOD(void)
+{
+	const uint32_t uInstanceNum = 100000, uFrames = 100;
+	std::vector<GLfloat> vVertices;
+	std::vector<GLuint> vIndices;
+	std::vector<SLODLevel> vLevels;
+	CBenchmarkScene::generateSphereLODs((std::max)(gSceneConfig.uTrianglesPerObject, 8u), vVertices, vIndices, vLevels);
+
+	/* instances in the volume of the benchmark scene */
+	struct SInstance { float vCenter[3]; float fRadius; };
+	std::vector<SInstance> vInstances(uInstanceNum);
+	uint32_t uRandom = gSceneConfig.uSeed;
+	auto random = [&uRandom]() {
+		uRandom = uRandom * 1664525u + 1013904223u;
+		return (uRandom >> 8) / 16777216.0f;
+	};
+	for (auto& rInstance : vInstances)
+		rInstance = { { -5.0f + 10.0f * random(), -2.0f + 4.0f * random(), -5.0f + 10.0f * random() }, 0.05f + 0.15f * random() };
+
+	/* two eyes 64 mm apart, canted outwards by the asymmetric frustums */
+	std::vector<COpenXRGL::SViewInfo> vViews(2);
+	for (uint32_t i = 0; i < 2; ++i)
+	{
+		COpenXRGL::SViewInfo& rView = vViews[i];
+		const float fOuter = -0.96f, fInner = 0.87f, fSign = i == 0 ? 1.0f : -1.0f;
+		rView.xrFov = { i == 0 ? fOuter : -fInner, i == 0 ? fInner : -fOuter, 0.89f, -0.94f };
+		rView.uWidth = (std::max)(gXRGL.getSwapchainWidth(i), 1u);
+		rView.uHeight = (std::max)(gXRGL.getSwapchainHeight(i), 1u);
+		rView.matModelView = { 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, fSign * 0.032f, 0, 0, 1 };
+	}
+
+	CLODSelector mSelector;
+	mSelector.setThreshold(gScene.getLODSelector().getThreshold());
+	CPerfCounter mCounter;
+	std::vector<uint64_t> vLevelCount(vLevels.size(), 0);
+	uint64_t uTriangles = 0;
+	for (uint32_t uFrame = 0; uFrame < uFrames; ++uFrame)
+	{
+		mCounter.begin();
+		mSelector.setViews(vViews, gPoseSource.getWorldMatrix(uFrame * 18));
+		for (const auto& rInstance : vInstances)
+		{
+			const uint32_t uLevel = mSelector.select(vLevels, rInstance.vCenter, rInstance.fRadius, rInstance.fRadius);
+			++vLevelCount[uLevel];
+			uTriangles += vLevels[uLevel].iIndexNum / 3;
+		}
+		mCounter.end(uInstanceNum);
+	}
+
+	const uint64_t uFullTriangles = (uint64_t)uInstanceNum * uFrames * (vLevels[0].iIndexNum / 3);
+	std::cout << "LOD benchmark (" << uInstanceNum << " instances, " << vLevels.size() << " levels, "
+		<< mSelector.getThreshold() << " px error, " << vViews[0].uWidth << " * " << vViews[0].uHeight << " per view)\n"
+		<< " - selection: " << mCounter.msPerSample() << " ms per " << uInstanceNum << " instances\n"
+		<< " - triangles: " << 100.0 * uTriangles / uFullTriangles << "% of full detail (" << uTriangles / uFrames << " / " << uFullTriangles / uFrames << " per frame)\n";
+	for (size_t i = 0; i < vLevels.size(); ++i)
+		std::cout << " - level " << i << " (" << vLevels[i].iIndexNum / 3 << " triangles): " << 100.0 * vLevelCount[i] / ((uint64_t)uInstanceNum * uFrames) << "%\n";
+	std::cout << std::endl;
+}
+
 int main(int argc, char** argv)
 {
-	#pragma region Initialize OpenGL
 	glutInit(&argc, argv);
+	gStartup.mark("process start and glutInit");
+
+	bool bBenchmarkFormats = false, bBenchmarkLOD = false;
+	for (int i = 1; i < argc; ++i)
+	{
+		std::string sArg = argv[i];
+		try
+		{
+			if (sArg == "--views" && i + 1 < argc)
+			{
+				std::string sViews = argv[++i];
+				if (sViews == "mono")
+					gXRGL.setViewConfiguration(XR_VIEW_CONFIGURATION_TYPE_PRIMARY_MONO);
+				else if (sViews == "quad")
+					gXRGL.setViewConfiguration(XR_VIEW_CONFIGURATION_TYPE_PRIMARY_QUAD_VARJO);
+				else
+					gXRGL.setViewConfiguration(XR_VIEW_CONFIGURATION_TYPE_PRIMARY_STEREO);
+			}
+			else if (sArg == "--format" && i + 1 < argc)
+			{
+				std::string sPolicy = argv[++i];
+				if (sPolicy == "bandwidth")
+					gXRGL.setSwapchainFormatPolicy(COpenXRGL::EFormatPolicy::LowBandwidth);
+				else if (sPolicy == "hdr")
+					gXRGL.setSwapchainFormatPolicy(COpenXRGL::EFormatPolicy::HDR);
+				else
+					gXRGL.setSwapchainFormatPolicy(COpenXRGL::EFormatPolicy::SRGB);
+			}
+			else if (sArg == "--bench-formats")
+			{
+				bBenchmarkFormats = true;
+			}
+			else if (sArg == "--skybox" && i + 1 < argc)
+			{
+				gSkyboxMode = argv[++i];
+			}
+			else if (sArg == "--skybox-size" && i + 1 < argc)
+			{
+				gSkyboxSize = (std::max)((uint32_t)std::stoul(argv[++i]), 16u);
+			}
+			else if (sArg == "--shader-cache" && i + 1 < argc)
+			{
+				gShaderCacheDir = argv[++i];
+			}
+			else if (sArg == "--no-shader-cache")
+			{
+				gShaderCacheDir.clear();
+			}
+			else if (sArg == "--no-mask")
+			{
+				gXRGL.setVisibilityMask(false);
+			}
+			else if (sArg == "--recycle-on-exit")
+			{
+				gXRGL.setRecycleOnExit(true);
+			}
+			else if (sArg == "--lod-error" && i + 1 < argc)
+			{
+				gScene.getLODSelector().setThreshold(std::stof(argv[++i]));
+			}
+			else if (sArg == "--bench-lod")
+			{
+				bBenchmarkLOD = true;
+			}
+			else if (sArg == "--lights" && i + 1 < argc)
+			{
+				gLightNum = (std::max)((uint32_t)std::stoul(argv[++i]), 1u);
+			}
+			else if (sArg == "--bench-lights")
+			{
+				gBenchmarkLights = true;
+			}
+			else if (sArg == "--scene")
+			{
+				gUseScene = true;
+			}
+			else if (i + 1 < argc && (sArg == "--objects" || sArg == "--triangles" || sArg == "--materials" ||
+				sArg == "--state-changes" || sArg == "--overdraw" || sArg == "--seed" || sArg == "--frames"))
+			{
+				const uint32_t uValue = (uint32_t)std::stoul(argv[++i]);
+				if (sArg == "--objects")
+					gSceneConfig.uObjectNum = uValue;
+				else if (sArg == "--triangles")
+					gSceneConfig.uTrianglesPerObject = uValue;
+				else if (sArg == "--materials")
+					gSceneConfig.uMaterialNum = uValue;
+				else if (sArg == "--state-changes")
+					gSceneConfig.uStateChanges = uValue;
+				else if (sArg == "--overdraw")
+					gSceneConfig.uOverdrawLayers = uValue;
+				else if (sArg == "--seed")
+					gSceneConfig.uSeed = uValue;
+				else
+					gBenchmarkFrames = uValue;
+			}
+			else if (sArg == "--out" && i + 1 < argc)
+			{
+				gResultFile = argv[++i];
+			}
+			else if (sArg == "--label" && i + 1 < argc)
+			{
+				gResultLabel = argv[++i];
+			}
+			else if (sArg == "--bake" && i + 2 < argc)
+			{
+				std::string sFile = argv[++i];
+				const uint32_t uTriangles = (uint32_t)std::stoul(argv[++i]);
+				std::vector<GLfloat> vVertices;
+				std::vector<GLuint> vIndices;
+				CBenchmarkScene::generateSphere((std::max)(uTriangles, 8u), vVertices, vIndices);
+				if (AssetFile::writeMesh(sFile, vVertices, vIndices))
+					std::cout << "Baked " << vIndices.size() / 3 << " triangles to " << sFile << std::endl;
+			}
+			else if (sArg == "--bake-texture" && i + 2 < argc)
+			{
+				/* Checkerboard with a full mip chain. */
+				std::string sFile = argv[++i];
+				const uint32_t uSize = (std::max)((uint32_t)std::stoul(argv[++i]), 1u);
+				std::vector<std::vector<uint8_t>> vMips;
+				for (uint32_t uMipSize = uSize; ; uMipSize /= 2)
+				{
+					std::vector<uint8_t> vData((size_t)uMipSize * uMipSize * 4);
+					for (uint32_t y = 0; y < uMipSize; ++y)
+						for (uint32_t x = 0; x < uMipSize; ++x)
+						{
+							const uint8_t uValue = (((x * uSize / uMipSize) / 32 + (y * uSize / uMipSize) / 32) % 2) ? 255 : 64;
+							uint8_t* pTexel = &vData[((size_t)y * uMipSize + x) * 4];
+							pTexel[0] = pTexel[1] = pTexel[2] = uValue;
+							pTexel[3] = 255;
+						}
+					vMips.push_back(std::move(vData));
+					if (uMipSize == 1 || vMips.size() == 16)
+						break;
+				}
+				if (AssetFile::writeTexture(sFile, uSize, uSize, vMips, true))
+					std::cout << "Baked " << uSize << "x" << uSize << " texture to " << sFile << std::endl;
+			}
+			else if (sArg == "--load" && i + 1 < argc)
+			{
+				gMeshFiles.push_back(argv[++i]);
+			}
+			else if (sArg == "--load-texture" && i + 1 < argc)
+			{
+				gTextureFiles.push_back(argv[++i]);
+			}
+			else if (sArg == "--frame-bound" && i + 1 < argc)
+			{
+				gFrameBoundMs = std::stod(argv[++i]);
+			}
+		}
+		catch (const std::exception&)
+		{
+			std::cout << "Error: invalid value for " << sArg << std::endl;
+			return 1;
+		}
+	}
+	gStartup.mark("command line, including asset baking");
+
+	/* The OpenXR instance, system and graphics requirements do not need GL: create them while the window is created. */
+	gXRGL.beginInit();
+
+	#pragma region Initialize OpenGL
+	glutInitContextVersion(4, 5);
+	glutInitContextProfile(GLUT_CORE_PROFILE);
 	glutInitDisplayMode(GLUT_DOUBLE | GLUT_RGB | GLUT_DEPTH);
 	glutCreateWindow("OpenXR + glut Cube");
+	glewExperimental = GL_TRUE;
 	glewInit();
+	glutSetOption(GLUT_ACTION_ON_WINDOW_CLOSE, GLUT_ACTION_GLUTMAINLOOP_RETURNS);
 	glutDisplayFunc(display);
-	glutIdleFunc([]() {glutPostRedisplay(); });
+	glutIdleFunc(idle);
+	glutCloseFunc(releaseGL);
+	gStartup.mark("window and GL context");
+
+	CGLProgram::setBinaryCache(gShaderCacheDir);
 	initGL();
+	gStartup.mark("GL resources");
 	#pragma endregion
 
-	gXRGL.init();
+	if (gXRGL.init())
+	{
+		gStartup.mark("OpenXR instance (overlapped), session and swapchains");
+		gViewWorks.resize(gXRGL.getViewCount());
+		std::cout << "Hidden area mask: " << (gXRGL.isVisibilityMaskUsed() ? "on" : "off") << std::endl;
+		if (bBenchmarkFormats)
+			benchmarkSwapchainFormats();
+		if (bBenchmarkLOD)
+			benchmarkLOD();
+
+		if (gUseScene && gScene.create(gSceneConfig, gXRGL.getViewCount()))
+		{
+			gXRGL.setGPUTiming(true);
+			gUniformRing.create(gScene.uniformSizePerFrame(gXRGL.getViewCount()));
+		}
+		else
+		{
+			gUseScene = false;
+		}
+
+		if (gLightNum == 0 && gUseScene)
+			gLightNum = gSceneLightNum;
+		if (gBenchmarkLights && gUseScene)
+		{
+			gLightNum = 8;
+			if (gBenchmarkFrames == 0)
+				gBenchmarkFrames = 300;
+		}
+		else
+		{
+			gBenchmarkLights = false;
+		}
+		gLights.create(gXRGL.getThreadPool(), gBenchmarkLights ? gBenchmarkMaxLights : (std::max)(gLightNum, 2u));
+		if (gLightNum == 0)
+		{
+			/* red and green, where the directional lights of the original sample came from */
+			gLights.setLights({
+				{ { 0.5f, 0.5f, 0.5f, 3.0f }, { 1.0f, 0.0f, 0.0f, 1.0f } },
+				{ { -0.5f, 0.5f, -0.5f, 3.0f }, { 0.0f, 1.0f, 0.0f, 1.0f } } });
+		}
+		else
+		{
+			gLights.setLights(CClusteredLights::generate(gLightNum, gSceneConfig.uSeed, gLightBoxMin, gLightBoxMax));
+		}
+
+		if (gSkyboxMode == "cube" || gSkyboxMode == "equirect")
+		{
+			const bool bCube = gSkyboxMode == "cube";
+			const bool bOK = bCube ?
+				gXRGL.setBackground(COpenXRGL::EBackground::Cube, gSkyboxSize, gSkyboxSize, CSkybox::generateCubeFaces(gSkyboxSize)) :
+				gXRGL.setBackground(COpenXRGL::EBackground::Equirect, gSkyboxSize * 2, gSkyboxSize, CSkybox::generateEquirect(gSkyboxSize * 2, gSkyboxSize));
+			if (!bOK || gXRGL.getBackground() == COpenXRGL::EBackground::None)
+				std::cout << "The runtime can't show a " << gSkyboxMode << " layer, draw the sky in the application" << std::endl;
+			else
+				std::cout << "Sky drawn by the compositor as a " << gSkyboxMode << " layer" << std::endl;
+			gDrawSkybox = !bOK || gXRGL.getBackground() == COpenXRGL::EBackground::None;
+		}
+		else if (gSkyboxMode == "app")
+		{
+			gDrawSkybox = true;
+		}
+		if (gDrawSkybox && !gSkybox.create(gSkyboxSize))
+			gDrawSkybox = false;
+
+		if ((!gMeshFiles.empty() || !gTextureFiles.empty()) && gAssetStreamer.start())
+		{
+			gAssetStreamer.setFrameTimeBound(gFrameBoundMs);
+			for (const auto& sFile : gMeshFiles)
+				gMeshIds.push_back(gAssetStreamer.requestMesh(sFile));
+			for (const auto& sFile : gTextureFiles)
+				gTextureIds.push_back(gAssetStreamer.requestTexture(sFile));
+			gXRGL.setGPUTiming(true);
+		}
+		gStartup.mark("application setup");
+
+		const CGLProgram::SBinaryCache& rCache = CGLProgram::binaryCache();
+		if (!rCache.sDirectory.empty())
+			std::cout << "Program binary cache: " << rCache.uHits << " loaded, " << rCache.uMisses << " compiled" << std::endl;
+	}
 
 	glutMainLoop();
+
+	/* The session and GL objects are gone with the window, see releaseGL(); only the OpenXR instance is left. */
+	gXRGL.releaseInstance();
 	return 0;
 }